@@ -8,13 +8,27 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
 #include <stdexcept>
 #include <string>
 #include <sstream>
+#include <thread>
 #include <vector>
 #include <windows.h>
 using namespace std;
@@ -28,7 +42,7 @@ const size_t NTEAMS = 30;
 const size_t NGAMES = 82;
 const caphit MAXCAP = 60e6;
 const caphit MAXAHLSALARY = 8e5;
-const double WAIVERAGE = 23;
+const int WAIVERAGE = 23;
 const size_t MINNPRO = 22;
 const int YEAR_FIRST = 2023;
 
@@ -43,1221 +57,5108 @@ const size_t NOPTIONS = 3;
 const size_t NSTATUSES = 6;
 const size_t NMISC = 5;
 const size_t NSTREAKS = 5;
+// Lines in one players.ehm record, from the first ratings line to the attitude line
+const size_t EHMRECORDLINES = 20;
 
 string SPACEREPLACE = ".";
 
-class Player
+/*
+ * Read-only view of an entire file, mapped into memory. Parsers tokenize the
+ * mapped bytes in place instead of going through iostream extraction.
+ */
+class MappedFile
 {
-	/*
-	 * Attributes go: sh pl st ch po hi sk en pe fa le sr fi (13 total)
-	 */
 	private:
-		static const int STATS = 13;
-		static const char SEP = ',';
-		int ratings[STATS];
-		int ceilings[STATS];
-
-		int pot;
-		int con;
-		int gre;
-		int click;
-		int team;
-		int position;
-		int country;
-		int hand;
-		int byear;
-		int bday;
-		int bmonth;
-		caphit salary;
-		int years;
-		int draftyear;
-		int draftedby;
-		int draftround;
-		int rights;
-		int id;
-
-		string dashcode;
-		string firstName;
-		string lastName;
-		string performance;
-
-		int thisweek[NPERFORMANCE];
-		int thismonth[NPERFORMANCE];
-		int records[NRECORDS];
-		int options[NOPTIONS];
-		int status[NSTATUSES];
-		string scout1;
-		string scout2;
-		string scout3;
-		int attitude;
-		int altpos;
-		int nhlrights;
-		int injuryprone;
-		int draftedoverall;
-		int misc[NMISC];
-		int height;
-		int weight;
-		int orgstatus;
-		int streaks[NSTREAKS];
-		string draftedstatus;
-		string EHMversion;
+		HANDLE file;
+		HANDLE mapping;
+		const char * data;
+		size_t size;
+
+		MappedFile(const MappedFile &) = delete;
+		MappedFile & operator=(const MappedFile &) = delete;
 
 	public:
-		Player(ifstream& inputFile, bool fromPlayersEHM, char * tempdata, const int tempdataSize, int iId)
+		MappedFile(const string & filename) : file(INVALID_HANDLE_VALUE), mapping(NULL), data(NULL), size(0)
 		{
-			id = iId;
-			if(fromPlayersEHM)
-			{
-				for(int i = 1; i < STATS; i++)
-				{
-					inputFile >> ratings[i];
-				}
-				inputFile >> pot;
-				inputFile >> con;
-				inputFile >> gre;
-				inputFile >> ratings[0];
-				inputFile >> click;
-				inputFile >> team;
-				inputFile >> position;
-				inputFile >> country;
-				inputFile >> hand;
-				inputFile >> byear;
-				inputFile >> bday;
-				inputFile >> bmonth;
-				inputFile >> salary;
-				inputFile >> years;
-				inputFile >> draftyear;
-				inputFile >> draftround;
-				inputFile >> draftedby;
-				inputFile >> rights;
-
-				for(size_t i = 0; i < NPERFORMANCE; i++) inputFile >> thisweek[i];
-				for(size_t i = 0; i < NPERFORMANCE; i++) inputFile >> thismonth[i];
-				for(size_t i = 0; i < NRECORDS; i++) inputFile >> records[i];
-				for(size_t i = 0; i < NOPTIONS; i++) inputFile >> options[i];
-				for(size_t i = 0; i < NSTATUSES; i++) inputFile >> status[i];
-
-				// Reads in the extra space after the last status
-				inputFile.getline(tempdata,tempdataSize);
-				inputFile.getline(tempdata,tempdataSize);
-				scout1 = string(tempdata);
-				inputFile.getline(tempdata,tempdataSize);
-				scout2 = string(tempdata);
-				inputFile.getline(tempdata,tempdataSize);
-				scout3 = string(tempdata);
-
-				for(size_t i = 0; i < NMISC; i++) inputFile >> misc[i];
-				inputFile >> weight;
-				inputFile >> height;
-				inputFile >> orgstatus;
-				for(size_t i = 0; i < NSTREAKS; i++) inputFile >> streaks[i];
-				// another extra space
-				inputFile.getline(tempdata,tempdataSize);
-				inputFile.getline(tempdata,tempdataSize);
-				dashcode = string(tempdata);
-
-				inputFile >> firstName;
-				// explicitly read the space between first and last name
-				inputFile.get();
-				inputFile.getline(tempdata,tempdataSize);
-				lastName = string(tempdata);
-
-				inputFile.getline(tempdata,tempdataSize);
-				performance = string(tempdata);
-				inputFile.getline(tempdata,tempdataSize);
-				draftedstatus = string(tempdata);
-				inputFile.getline(tempdata,tempdataSize);
-
-				char ceil[3];
-				for(size_t i = 0; i < STATS; i++)
-				{
-					for(int j=0; j<3; j++)
-					{
-						ceil[j] = tempdata[i*3+j];
-					}
-					ceilings[i] = atoi(ceil);
-				}
+			file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+				OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+			if(file == INVALID_HANDLE_VALUE) return;
 
-				inputFile.getline(tempdata,tempdataSize);
-				EHMversion = string(tempdata);
-				inputFile.getline(tempdata,tempdataSize);
+			LARGE_INTEGER fileSize;
+			// Empty files can't be mapped, and there's nothing to read anyway
+			if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart <= 0) return;
 
-				inputFile >> attitude;
-				inputFile >> altpos;
-				inputFile >> nhlrights;
-				inputFile >> injuryprone;
-				inputFile >> draftedoverall;
-			}
-			else
-			{
-				std::string buf;
-				try
-				{
-					for(int i = 1; i < STATS; i++)
-					{
-						getline(inputFile, buf, SEP);
-						ratings[i] = atol(buf.c_str());
-					}
-					getline(inputFile, buf, SEP); pot = atol(buf.c_str());
-					getline(inputFile, buf, SEP); con = atol(buf.c_str());
-					getline(inputFile, buf, SEP); gre = atol(buf.c_str());
-					getline(inputFile, buf, SEP); ratings[0] = atol(buf.c_str());
-					getline(inputFile, buf, SEP); click = atol(buf.c_str());
-					getline(inputFile, buf, SEP); team = atol(buf.c_str());
-					getline(inputFile, buf, SEP); position = atol(buf.c_str());
-					getline(inputFile, buf, SEP); country = atol(buf.c_str());
-					getline(inputFile, buf, SEP); hand = atol(buf.c_str());
-					getline(inputFile, buf, SEP); byear = atol(buf.c_str());
-					getline(inputFile, buf, SEP); bday = atol(buf.c_str());
-					getline(inputFile, buf, SEP); bmonth = atol(buf.c_str());
-					getline(inputFile, buf, SEP); salary = atol(buf.c_str());
-					getline(inputFile, buf, SEP); years = atol(buf.c_str());
-					getline(inputFile, buf, SEP); draftyear = atol(buf.c_str());
-					getline(inputFile, buf, SEP); draftround = atol(buf.c_str());
-					getline(inputFile, buf, SEP); draftedby = atol(buf.c_str());
-					getline(inputFile, buf, SEP); rights = atol(buf.c_str());
-					for(size_t i = 0; i < NPERFORMANCE; i++)
-					{
-						getline(inputFile, buf, SEP);
-						thisweek[i] = atol(buf.c_str());
-					}
-					for(size_t i = 0; i < NPERFORMANCE; i++)
-					{
-						getline(inputFile, buf, SEP);
-						thismonth[i] = atol(buf.c_str());
-					}
-					for(size_t i = 0; i < NRECORDS; i++)
-					{
-						getline(inputFile, buf, SEP);
-						records[i] = atol(buf.c_str());
-					}
-					for(size_t i = 0; i < NOPTIONS; i++)
-					{
-						getline(inputFile, buf, SEP);
-						options[i] = atol(buf.c_str());
-					}
-					for(size_t i = 0; i < NSTATUSES; i++)
-					{
-						getline(inputFile, buf, SEP);
-						status[i] = atol(buf.c_str());
-					}
-					getline(inputFile, scout1, SEP);
-					getline(inputFile, scout2, SEP);
-					getline(inputFile, scout3, SEP);
-					for(size_t i = 0; i < NMISC; i++)
-					{
-						getline(inputFile, buf, SEP);
-						misc[i] = atol(buf.c_str());
-					}
-					getline(inputFile, buf, SEP); weight = atol(buf.c_str());
-					getline(inputFile, buf, SEP); height = atol(buf.c_str());
-					getline(inputFile, buf, SEP); orgstatus = atol(buf.c_str());
-					for(size_t i = 0; i < NSTREAKS; i++)
-					{
-						getline(inputFile, buf, SEP);
-						streaks[i] = atol(buf.c_str());
-					}
-					getline(inputFile, dashcode, SEP);
-					getline(inputFile, firstName, SEP);
-					getline(inputFile, lastName, SEP);
-					getline(inputFile, performance, SEP);
-					getline(inputFile, draftedstatus, SEP);
-					for(size_t i = 0; i < STATS; i++)
-					{
-						getline(inputFile, buf, SEP);
-						ceilings[i] = atol(buf.c_str());
-					}
-					getline(inputFile, EHMversion, SEP);
-					getline(inputFile, buf, SEP); attitude = atol(buf.c_str());
-					getline(inputFile, buf, SEP); altpos = atol(buf.c_str());
-					getline(inputFile, buf, SEP); nhlrights = atol(buf.c_str());
-					getline(inputFile, buf, SEP); injuryprone = atol(buf.c_str());
-					getline(inputFile, buf); draftedoverall = atol(buf.c_str());
-				}
-				catch(exception & e)
-				{
-					cout << "Standard exception: " << e.what() << endl;
-				}
-			}
-		};
+			mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if(mapping == NULL) return;
+
+			data = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			if(data != NULL) size = fileSize.QuadPart;
+		}
 
-		int getContractLength() const
+		~MappedFile()
 		{
-			return this->years;
+			if(data != NULL) UnmapViewOfFile(data);
+			if(mapping != NULL) CloseHandle(mapping);
+			if(file != INVALID_HANDLE_VALUE) CloseHandle(file);
 		}
 
-		caphit getSalary() const
+		bool is_open() const
 		{
-			return max(this->salary,MINCAPHIT);
+			return file != INVALID_HANDLE_VALUE;
 		}
 
-		int getTeam() const
+		const char * begin() const
 		{
-			return this->team;
+			return data;
 		}
 
-		string getFirstName() const
+		const char * end() const
 		{
-			return this->firstName;
+			return data + size;
 		}
 
-		string getLastName() const
+		size_t getSize() const
 		{
-			return this->lastName;
+			return size;
 		}
+};
 
-		int getRating(int rating) const
+/*
+ * Tokenizes a players.ehm buffer in place. Each read mirrors the ifstream call
+ * the EHM format was originally parsed with: readInt is operator>>, readLine is
+ * getline (with text-mode CRLF handling) and get is get().
+ */
+class EHMTokenizer
+{
+	private:
+		const char * pos;
+		const char * last;
+
+		static bool isSpace(char c)
 		{
-			assert(rating < STATS);
-			return ratings[rating];
+			return c == ' ' || (c >= '\t' && c <= '\r');
 		}
 
-		int getRights() const
+		void skipSpace()
 		{
-			return rights;
+			while(pos < last && isSpace(*pos)) ++pos;
 		}
 
-		int getConsistency() const
+	public:
+		EHMTokenizer(const char * begin, const char * end) : pos(begin), last(end)
 		{
-			return con;
+			;
 		}
 
-		int getId() const
+		bool atEnd() const
 		{
-			return id;
+			return pos >= last;
 		}
 
-		// return age as of a certain date. No it's not exact, no I don't care.
-		double getAge(int year, int month, int day) const
+		// Whether anything but whitespace is left
+		bool moreTokens()
 		{
-			double age = year-byear;
-			age += (month-bmonth)/12.;
-			age += (day-bday)/365.;
-			return age;
+			skipSpace();
+			return pos < last;
 		}
 
-		void outputDataEHM(ofstream& outputFile) const
+		const char * position() const
 		{
-			outputFile << " ";
-			for(int i = 1; i <= 10; i++)
-			{
-				outputFile << ratings[i];
-				if(i < 10) outputFile << EHMSEP;
-			}
-			outputFile << " " << endl;
-			outputFile << " " << ratings[11] << EHMSEP << ratings[12] << EHMSEP;
-			outputFile << pot << EHMSEP;
-			outputFile << con << EHMSEP;
-			outputFile << gre << EHMSEP;
-			outputFile << ratings[0] << EHMSEP;
-			outputFile << click << EHMSEP;
-			outputFile << team << EHMSEP;
-			outputFile << position << EHMSEP;
-			outputFile << country << EHMSEP;
-			outputFile << hand << " " << endl;
-			outputFile << " " << byear << EHMSEP;
-			outputFile << bday << EHMSEP;
-			outputFile << bmonth << EHMSEP;
-			outputFile << salary << EHMSEP;
-			outputFile << years << EHMSEP;
-			outputFile << draftyear << EHMSEP;
-			outputFile << draftround << EHMSEP;
-			outputFile << draftedby << EHMSEP;
-			outputFile << rights << " " << endl << " ";
+			return pos;
+		}
 
-			for(size_t i = 0; i < NPERFORMANCE; i++)
-			{
-				outputFile << thisweek[i];
-				if(i == (NPERFORMANCE-1)) outputFile << " " << endl << " ";
-				else outputFile << EHMSEP;
-			}
-			for(size_t i = 0; i < NPERFORMANCE; i++)
-			{
-				outputFile << thismonth[i];
-				if(i == (NPERFORMANCE-1)) outputFile << " " << endl << " ";
-				else outputFile << EHMSEP;
-			}
-			for(size_t i = 0; i < NRECORDS; i++)
-			{
-				outputFile << records[i] << EHMSEP;
-			}
-			for(size_t i = 0; i < NOPTIONS; i++)
-			{
-				outputFile << options[i];
-				if(i == (NOPTIONS-1)) outputFile << " " << endl << " ";
-				else outputFile << EHMSEP;
-			}
-			for(size_t i = 0; i < NSTATUSES; i++)
-			{
-				outputFile << status[i];
-				if(i == (NSTATUSES-1)) outputFile << " " << endl;
-				else outputFile << EHMSEP;
-			}
+		const char * end() const
+		{
+			return last;
+		}
 
-			outputFile << scout1 << endl;
-			outputFile << scout2 << endl;
-			outputFile << scout3 << endl;
+		void seek(const char * iPos)
+		{
+			pos = iPos;
+		}
 
-			for(size_t i = 0; i < NMISC; i++)
+		template <typename T> T readInt()
+		{
+			skipSpace();
+			bool negative = false;
+			if(pos < last && (*pos == '-' || *pos == '+'))
 			{
-				if(misc[i] >= 0) outputFile << " ";
-				outputFile << misc[i] << " ";
-				if(i == 4) outputFile << " ";
+				negative = *pos == '-';
+				++pos;
 			}
-			outputFile << weight << EHMSEP;
-			outputFile << height << EHMSEP;
-			outputFile << orgstatus << " " << endl << " ";
-			for(size_t i = 0; i < NSTREAKS; i++)
+			T value = 0;
+			while(pos < last && unsigned(*pos - '0') < 10)
 			{
-				outputFile << streaks[i];
-				if(i == (NSTREAKS-1)) outputFile << " " << endl;
-				else outputFile << EHMSEP;
+				value = value*10 + (*pos - '0');
+				++pos;
 			}
+			return negative ? -value : value;
+		}
 
-			outputFile << dashcode << endl;
-			outputFile << firstName << " " << lastName << endl;
-			outputFile << performance << endl << draftedstatus << endl;
+		// Equivalent of getline: the line excludes the newline, which is consumed
+		void readLine(const char * & begin, size_t & length)
+		{
+			begin = pos;
+			const char * eol = static_cast<const char *>(memchr(pos, '\n', last - pos));
+			if(eol == NULL) eol = last;
+			pos = eol < last ? eol + 1 : last;
+			if(eol > begin && *(eol-1) == '\r') --eol;
+			length = eol - begin;
+		}
 
-			char ceil[3];
-			for(size_t i = 0; i < STATS; i++)
-			{
-				sprintf(ceil, "%03d", ceilings[i]);
-				outputFile << ceil;
-			}
+		void readLine(string & line)
+		{
+			const char * begin; size_t length;
+			readLine(begin, length);
+			line.assign(begin, length);
+		}
 
-			outputFile << endl << EHMversion << endl << EHMversion << endl;
-			if(attitude >= 0) outputFile << " ";
-			outputFile << attitude << EHMSEP << altpos << EHMSEP << nhlrights;
-			outputFile << EHMSEP << injuryprone << EHMSEP << draftedoverall << " " << endl;
+		void skipLine()
+		{
+			const char * begin; size_t length;
+			readLine(begin, length);
 		}
 
-		void outputDataCSV(ofstream& outputFile, size_t row) const
-		{
-			for(size_t i = 1; i < STATS; i++) outputFile << ratings[i] << SEP;
-			outputFile << pot << SEP;
-			outputFile << con << SEP;
-			outputFile << gre << SEP;
-			outputFile << ratings[0] << SEP;
-			outputFile << click << SEP;
-			outputFile << team << SEP;
-			outputFile << position << SEP;
-			outputFile << country << SEP;
-			outputFile << hand << SEP;
-			outputFile << byear << SEP;
-			outputFile << bday << SEP;
-			outputFile << bmonth << SEP;
-			outputFile << salary << SEP;
-			outputFile << years << SEP;
-			outputFile << draftyear << SEP;
-			outputFile << draftround << SEP;
-			outputFile << draftedby << SEP;
-			outputFile << rights << SEP;
-
-			for(size_t i = 0; i < NPERFORMANCE; i++) outputFile << thisweek[i] << SEP;
-			for(size_t i = 0; i < NPERFORMANCE; i++) outputFile << thismonth[i] << SEP;
-			for(size_t i = 0; i < NRECORDS; i++) outputFile << records[i] << SEP;
-			for(size_t i = 0; i < NOPTIONS; i++) outputFile << options[i] << SEP;
-			for(size_t i = 0; i < NSTATUSES; i++) outputFile << status[i] << SEP;
-			outputFile << scout1 << SEP << scout2 << SEP << scout3 << SEP;
-
-			for(size_t i = 0; i < NMISC; i++) outputFile << misc[i] << SEP;
-			outputFile << weight << SEP << height << SEP << orgstatus << SEP;
-			for(size_t i = 0; i < NSTREAKS; i++) outputFile << streaks[i] << SEP;
-			outputFile << dashcode << SEP;
-			outputFile << firstName << SEP << lastName << SEP;
-			outputFile << performance << SEP << draftedstatus << SEP;
+		// Equivalent of operator>> into a string
+		void readWord(const char * & begin, size_t & length)
+		{
+			skipSpace();
+			begin = pos;
+			while(pos < last && !isSpace(*pos)) ++pos;
+			length = pos - begin;
+		}
 
-			for(int i = 0; i < STATS; i++) outputFile << ceilings[i] << SEP;
+		void readWord(string & word)
+		{
+			const char * begin; size_t length;
+			readWord(begin, length);
+			word.assign(begin, length);
+		}
 
-			outputFile << EHMversion << SEP << attitude << SEP;
-			outputFile << altpos << SEP << nhlrights << SEP;
-			outputFile << injuryprone << SEP << draftedoverall << SEP << row << endl;
-		};
+		void get()
+		{
+			if(pos < last) ++pos;
+		}
 };
 
-bool higherSalary(Player* i, Player* j)
+// atoi over a fixed-width field that isn't null-terminated, e.g. one of the 3-digit ceilings
+int parseFixedWidth(const char * field, size_t width)
 {
-	return i->getSalary() > j->getSalary();
+	const char * end = field + width;
+	while(field < end && (*field == ' ' || (*field >= '\t' && *field <= '\r'))) ++field;
+	bool negative = false;
+	if(field < end && (*field == '-' || *field == '+'))
+	{
+		negative = *field == '-';
+		++field;
+	}
+	int value = 0;
+	while(field < end && unsigned(*field - '0') < 10)
+	{
+		value = value*10 + (*field - '0');
+		++field;
+	}
+	return negative ? -value : value;
 }
 
-class SalaryBrackets
+/*
+ * Block-buffered reader for the comma-separated player rows. Each block is
+ * scanned once, eight bytes at a time, for separator and newline positions;
+ * rows are then split from that index and integers parsed straight out of the
+ * buffer. Malformed fields throw with their row and column.
+ */
+class CSVReader
 {
 	private:
-		bool initialized;
-		bool usingBrackets;
-		int novbrackets;
-		int * ovbrackets;
-		int * nsalarybrackets;
-		double ** salarybrackets;
-		double ** raises;
-		void deallocate()
-		{
-			if(usingBrackets)
-			{
-				delete[] raises[novbrackets-1];
-				for(int ovbracket = novbrackets-2; ovbracket >= 0; --ovbracket)
-				{
-					delete[] salarybrackets[ovbracket];
-					delete[] raises[ovbracket];
-				}
+		static const size_t BLOCKSIZE = 1 << 20;
+
+		istream & input;
+		const char sep;
+		vector<char> buffer;
+		size_t dataEnd;
+		size_t rowStart;
+		// offsets of every separator and newline in the buffer, in order
+		vector<uint32_t> delims;
+		size_t nextDelim;
+		// offsets of the end of each field in the current row
+		vector<uint32_t> fieldEnds;
+		size_t column;
+		size_t row;
+
+		static uint64_t broadcast(char c)
+		{
+			return 0x0101010101010101ULL * (unsigned char)c;
+		}
 
-				delete[] raises;
-				delete[] salarybrackets;
+		// High bit set in each byte of word that is zero (no false positives)
+		static uint64_t zeroBytes(uint64_t word)
+		{
+			const uint64_t low7 = 0x7F7F7F7F7F7F7F7FULL;
+			return ~(((word & low7) + low7) | word | low7);
+		}
 
-				delete[] ovbrackets;
-				delete[] nsalarybrackets;
+		void scan(size_t from)
+		{
+			const uint64_t seps = broadcast(sep);
+			const uint64_t newlines = broadcast('\n');
+			const char * data = &buffer[0];
+			size_t i = from;
+			for(; i + 8 <= dataEnd; i += 8)
+			{
+				uint64_t word;
+				memcpy(&word, data + i, 8);
+				uint64_t matches = zeroBytes(word ^ seps) | zeroBytes(word ^ newlines);
+				while(matches)
+				{
+					delims.push_back(i + (__builtin_ctzll(matches) >> 3));
+					matches &= matches - 1;
+				}
+			}
+			for(; i < dataEnd; i++)
+			{
+				if(data[i] == sep || data[i] == '\n') delims.push_back(i);
 			}
-
-			initialized = false;
 		}
-		int getOvbracket(double overall)
+
+		// Moves the unfinished row to the front of the buffer and reads the next block
+		bool refill()
 		{
-			for(int ovbracket = 0; ovbracket < novbrackets-1; ovbracket++)
+			if(!input) return false;
+			size_t kept = dataEnd - rowStart;
+			if(rowStart > 0)
+			{
+				memmove(&buffer[0], &buffer[rowStart], kept);
+			}
+			else if(kept > 0)
 			{
-				if(overall < ovbrackets[ovbracket]) return ovbracket;
+				buffer.resize(buffer.size()*2);
 			}
-			return novbrackets-1;
+			dataEnd = kept;
+			rowStart = 0;
+			input.read(&buffer[dataEnd], buffer.size() - dataEnd);
+			dataEnd += input.gcount();
+			delims.clear();
+			nextDelim = 0;
+			scan(0);
+			return input.gcount() > 0;
+		}
+
+		const char * fieldBegin(size_t col) const
+		{
+			return &buffer[0] + (col == 0 ? rowStart : fieldEnds[col-1] + 1);
 		}
-		int getSalaryBracket(int ovbracket, double salary)
+
+		const char * fieldEnd(size_t col) const
 		{
-			int novsalarybrackets = nsalarybrackets[ovbracket];
+			const char * end = &buffer[0] + fieldEnds[col];
+			// text-mode CRLF on the last field
+			if(col == fieldEnds.size() - 1 && end > fieldBegin(col) && *(end-1) == '\r') --end;
+			return end;
+		}
 
-			for(int salarybracket = 0; salarybracket < novsalarybrackets-1; salarybracket++)
+		const char * nextField(const char * & end)
+		{
+			if(column >= fieldEnds.size())
 			{
-				if(salary < salarybrackets[ovbracket][salarybracket]) return salarybracket;
+				throw runtime_error("Error! Row " + to_string(row) + " has only " +
+					to_string(fieldEnds.size()) + " columns; aborting.");
 			}
-			return novsalarybrackets-1;
+			end = fieldEnd(column);
+			return fieldBegin(column++);
 		}
 
 	public:
-		void initialize(istream & inputStream)
+		CSVReader(istream & iInput, char iSep) : input(iInput), sep(iSep), buffer(BLOCKSIZE),
+			dataEnd(0), rowStart(0), nextDelim(0), column(0), row(0)
 		{
-			if(!initialized)
-			{
-				inputStream >> novbrackets;
-
-				ovbrackets = new int[novbrackets-1];
-				nsalarybrackets = new int[novbrackets];
-				salarybrackets = new double*[novbrackets];
-				raises = new double*[novbrackets];
+			;
+		}
 
-				for(int ovbracket = 0; ovbracket < novbrackets-1; ovbracket++)
+		// Splits the next non-empty row into fields; returns false at end of input
+		bool nextRow()
+		{
+			bool found = false;
+			while(!found)
+			{
+				fieldEnds.clear();
+				bool complete = false;
+				size_t i = nextDelim;
+				while(!complete && i < delims.size())
 				{
-					inputStream >> ovbrackets[ovbracket];
+					fieldEnds.push_back(delims[i]);
+					complete = buffer[delims[i]] == '\n';
+					i++;
 				}
-				for(int ovbracket = 0; ovbracket < novbrackets; ovbracket++)
+				if(!complete)
 				{
-					inputStream >> nsalarybrackets[ovbracket];
-					salarybrackets[ovbracket] = new double [nsalarybrackets[ovbracket]-1];
-					raises[ovbracket] = new double [nsalarybrackets[ovbracket]];
-					for(int salarybracket = 0; salarybracket < nsalarybrackets[ovbracket]-1; salarybracket++)
-					{
-						inputStream >> salarybrackets[ovbracket][salarybracket];
-						salarybrackets[ovbracket][salarybracket]*=1.e6;
-					}
-					for(int salarybracket = 0; salarybracket < nsalarybrackets[ovbracket]; salarybracket++)
-					{
-						inputStream >> raises[ovbracket][salarybracket];
-					}
+					if(refill()) continue;
+					// last line without a newline
+					if(rowStart == dataEnd) return false;
+					fieldEnds.push_back(dataEnd);
+					i = delims.size();
 				}
-				initialized = true;
-				usingBrackets = true;
+				row++;
+				column = 0;
+				nextDelim = i;
+				const char * end = fieldEnd(fieldEnds.size() - 1);
+				found = fieldEnds.size() > 1 || end > fieldBegin(0);
+				if(!found) rowStart = fieldEnds.back() + 1;
 			}
+			return true;
 		}
 
-		double getSalary(double initialSalary, double overall)
+		// Drops the current row and moves on to the next
+		void finishRow()
 		{
-			int ovbracket = getOvbracket(overall);
-			int salarybracket = getSalaryBracket(ovbracket, initialSalary);
+			rowStart = min(size_t(fieldEnds.back() + 1), dataEnd);
+		}
 
-			double raise = raises[ovbracket][salarybracket];
+		size_t getRow() const
+		{
+			return row;
+		}
 
-			return initialSalary * (1.0 + raise/100.);
+		size_t getColumns() const
+		{
+			return fieldEnds.size();
 		}
 
-		SalaryBrackets(istream & inputStream)
+		bool peekQuoted() const
 		{
-			initialized = false;
-			initialize(inputStream);
+			return fieldBegin(0) < fieldEnd(0) && *fieldBegin(0) == '"';
+		}
+
+		template <typename T> T readInt()
+		{
+			const char * end;
+			const char * field = nextField(end);
+			const char * pos = field;
+			while(pos < end && *pos == ' ') ++pos;
+			bool negative = false;
+			if(pos < end && (*pos == '-' || *pos == '+'))
+			{
+				negative = *pos == '-';
+				++pos;
+			}
+			const char * digits = pos;
+			T value = 0;
+			while(pos < end && unsigned(*pos - '0') < 10)
+			{
+				value = value*10 + (*pos - '0');
+				++pos;
+			}
+			bool valid = pos > digits;
+			while(pos < end && *pos == ' ') ++pos;
+			if(!valid || pos != end)
+			{
+				throw runtime_error("Error! Malformed integer '" + string(field, end) +
+					"' at row " + to_string(row) + " column " + to_string(column) + "; aborting.");
+			}
+			return negative ? -value : value;
 		}
 
-		SalaryBrackets(bool iUsingBrackets = false):usingBrackets(iUsingBrackets)
+		void readString(const char * & begin, size_t & length)
 		{
-			if(!usingBrackets) initialized = true;
+			const char * end;
+			begin = nextField(end);
+			length = end - begin;
 		}
 
-		~SalaryBrackets()
+		void readString(string & field)
 		{
-			deallocate();
+			const char * begin; size_t length;
+			readString(begin, length);
+			field.assign(begin, length);
 		}
 };
 
-class PlayerRater
+/*
+ * Reusable output buffer for the player writers. Text and integers are
+ * formatted straight into one large block, which goes to the stream in a
+ * single write when it fills up (or on flush), instead of a stream insertion
+ * per field and a flush per endl. Integers come out exactly as operator<<
+ * writes them.
+ */
+class OutputBuffer
 {
-	public:
-		double maxweight;
-		double minweight;
+	private:
+		static const size_t BLOCKSIZE = 1 << 20;
+		// longest integer we format, sign included
+		static const size_t MAXDIGITS = 24;
 
-		PlayerRater(double iMaxweight=0.5, double iMinweight=0.5) : maxweight(iMaxweight),minweight(iMinweight)
+		ostream & output;
+		vector<char> buffer;
+		size_t used;
+
+		OutputBuffer(const OutputBuffer &) = delete;
+		OutputBuffer & operator=(const OutputBuffer &) = delete;
+
+		char * reserve(size_t length)
+		{
+			if(used + length > buffer.size()) flush();
+			return &buffer[used];
+		}
+
+	public:
+		OutputBuffer(ostream & iOutput) : output(iOutput), buffer(BLOCKSIZE), used(0)
 		{
 			;
 		}
 
-		double getOFF(const Player & player)
+		~OutputBuffer()
 		{
-			double off = (player.getRating(1) + player.getRating(2) + player.getRating(3))/3.0;
-			return off;
+			flush();
 		}
 
-		double getDEF(const Player & player)
+		void flush()
 		{
-			double off = (player.getRating(4) + player.getRating(5) + player.getRating(6))/3.0;
-			return off;
+			if(used > 0) output.write(&buffer[0], used);
+			used = 0;
 		}
 
-		double getOverall(const Player & player)
+		void append(const char * text, size_t length)
 		{
-			double off = getOFF(player);
-			double def = getDEF(player);
+			if(length > buffer.size())
+			{
+				flush();
+				output.write(text, length);
+				return;
+			}
+			memcpy(reserve(length), text, length);
+			used += length;
+		}
 
-			return (max(off,def)*maxweight + min(off,def)*minweight);
+		// Writes value in decimal, zero-padded to width like printf's %0*d
+		template <typename T> void appendInt(T value, size_t width = 0)
+		{
+			char digits[MAXDIGITS];
+			char * first = digits + MAXDIGITS;
+			bool negative = value < 0;
+			// negate digit by digit so the most negative value works too
+			do
+			{
+				int digit = value % 10;
+				*--first = '0' + (negative ? -digit : digit);
+				value /= 10;
+			}
+			while(value != 0);
+			size_t length = digits + MAXDIGITS - first + negative;
+			while(length < width && first > digits + 1)
+			{
+				*--first = '0';
+				length++;
+			}
+			if(negative) *--first = '-';
+			append(first, digits + MAXDIGITS - first);
 		}
-};
 
-double statBonuses(const Player & player)
-{
-	double bonus = 0;
+		OutputBuffer & operator<<(char c)
+		{
+			*reserve(1) = c;
+			used++;
+			return *this;
+		}
 
-	for(int rating=7; rating < 13; rating++)
-	{
-		if(player.getRating(rating) > 80)
+		OutputBuffer & operator<<(const char * text)
 		{
-			bonus += 250000;
+			append(text, strlen(text));
+			return *this;
 		}
-	}
-	if(player.getConsistency() > 80) bonus +=250000;
 
-	return bonus;
-}
+		OutputBuffer & operator<<(const string & text)
+		{
+			append(text.data(), text.size());
+			return *this;
+		}
 
-double getSalary(double currentSalary,double overall)
-{
-	double minov = 67;
-	double midov = 75;
-	double maxov = 87;
+		OutputBuffer & operator<<(int value)
+		{
+			appendInt(value);
+			return *this;
+		}
 
-	double minsalary = 400000;
-	double maxsalary = 8e6;
+		OutputBuffer & operator<<(long long value)
+		{
+			appendInt(value);
+			return *this;
+		}
 
-	double qualratio = 1.1;
+		OutputBuffer & operator<<(size_t value)
+		{
+			appendInt(value);
+			return *this;
+		}
+};
 
-	if(overall < minov) return currentSalary*qualratio;
-	if(overall > maxov) overall = maxov;
-	double exponent = 1.0;
-	if(overall >= midov)
-	{
-		exponent -= (overall-midov)/(maxov-midov);
-	}
-	else
+// 64-bit hash of a whole buffer, a word at a time; only used to spot changed files
+uint64_t hashBytes(const char * data, size_t size)
+{
+	const uint64_t PRIME = 0x100000001B3ULL;
+	uint64_t hash = 0xCBF29CE484222325ULL ^ size;
+	size_t i = 0;
+	for(; i + 8 <= size; i += 8)
 	{
-		exponent += (midov-overall)/(midov-minov);
+		uint64_t word;
+		memcpy(&word, data + i, 8);
+		hash = (hash ^ word) * PRIME;
+		hash ^= hash >> 29;
 	}
+	for(; i < size; i++) hash = (hash ^ (unsigned char)data[i]) * PRIME;
+	return hash ^ (hash >> 32);
+}
 
-	double basesalary = minsalary + pow((overall-minov)/(maxov-minov),exponent)*(maxsalary-minsalary);
-
-	if(currentSalary >= basesalary) return currentSalary*qualratio;
+// Size and last write time of a file, false if it can't be read
+bool getFileStamp(const string & filename, uint64_t & size, uint64_t & mtime)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if(!GetFileAttributesExA(filename.c_str(), GetFileExInfoStandard, &attributes)) return false;
+	size = (uint64_t(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+	mtime = (uint64_t(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+	return true;
+}
 
-	double minlevel = 0.7;
+/*
+ * Header of a binary player snapshot (<players file>.snap, or .raw.snap when
+ * the file is read without its count line). A snapshot is only used if
+ * everything down to rows matches the source file it was taken from and the
+ * way it was parsed; the columns follow in
+ * PlayerTable::forEachColumn order, then the text arena.
+ */
+struct SnapshotHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t rowBytes;
+	uint64_t sourceSize;
+	uint64_t sourceMtime;
+	uint64_t sourceHash;
+	// whether the player count line was read before the records
+	uint64_t countLine;
+	uint64_t rows;
+	uint64_t textSize;
+};
 
-	double newsalary = minlevel*basesalary + (qualratio-minlevel)*basesalary*((currentSalary-minsalary)/(basesalary-minsalary));
+const char SNAPSHOTMAGIC[8] = {'E','H','M','S','N','A','P','\0'};
+const uint32_t SNAPSHOTVERSION = 1;
 
-	return max(newsalary,max(minsalary,currentSalary)*qualratio);
-}
+// Location of a string in PlayerTable's text arena
+struct TextSpan
+{
+	uint32_t offset;
+	uint32_t length;
+};
 
-void outputNewSalaryInfo(double currentSalary, double overall, ofstream & outputStream, SalaryBrackets & brackets, double statbonus=-1, double otherbonus=-1)
+// A string in PlayerTable's text arena, valid as long as the table is
+struct TextView
 {
-	double salary = brackets.getSalary(currentSalary,overall);
-	if(statbonus >= 0)
-	{
-		salary += statbonus;
-	}
-	if(otherbonus >= 0)
-	{
-		salary += otherbonus;
-	}
-	outputStream << salary/1.e6;
-	if(statbonus >= 0)
-	{
-		outputStream << "\t" << statbonus/1.e6;
-	}
-	if(otherbonus >= 0)
+	const char * data;
+	size_t size;
+
+	string str() const
 	{
-		outputStream << "\t" << otherbonus/1.e6;
+		return string(data, size);
 	}
-}
+};
 
-void outputNewSalaryInfo(double currentSalary, double overall, ofstream & outputStream, double bonus=0)
+ostream & operator<<(ostream & out, const TextView & view)
 {
-	outputStream << (getSalary(currentSalary,overall)+bonus)/1e6;
+	return out.write(view.data, view.size);
 }
 
-void outputNewSalaryInfo(const Player & player, double overall, ofstream & outputStream, SalaryBrackets & brackets, double otherBonus = 0)
+/*
+ * How a number is laid out in players.ehm: what follows it, plus
+ * EHMSIGNPAD for a space before it when it isn't negative. The schema
+ * passes these as EHMLayout types so each field's layout is fixed when
+ * it's compiled.
+ */
+enum EHMFormat
 {
-	double currentSalary = player.getSalary();
-	outputStream << player.getLastName() << ", " << player.getFirstName() << "\t" << overall << "\t" << currentSalary/1.e6 << "\t";
-	outputNewSalaryInfo(currentSalary,overall,outputStream,brackets,statBonuses(player),otherBonus);
-	outputStream << endl;
-}
+	EHMAFTERSEP = 0,
+	EHMAFTERSPACE = 1,
+	EHMAFTERSPACES = 2,
+	// " \n ", the next line's numbers being indented
+	EHMAFTERLINE = 3,
+	// " \n" before a line of text; parsing skips the rest of the line
+	EHMAFTERLINEREST = 4,
+	// " \n" at the end of a record
+	EHMAFTERRECORD = 5,
+	EHMAFTERMASK = 0xf,
+	EHMSIGNPAD = 0x10
+};
 
-void outputNewSalaryInfo(const Player & player, double overall, ofstream & outputStream)
+template <int Format> struct EHMLayout
 {
-	double currentSalary = player.getSalary();
-	outputStream << player.getLastName() << ", " << player.getFirstName() << "\t" << overall << "\t" << currentSalary/1.e6 << "\t";
-	outputNewSalaryInfo(currentSalary,overall,outputStream);
-	outputStream << endl;
+};
+
+template <int A, int B> EHMLayout<A | B> operator|(EHMLayout<A>, EHMLayout<B>)
+{
+	return EHMLayout<A | B>();
 }
 
-void outputNewSalariesInfo(const vector<Player> & players, size_t nplayers, string outputFilename, string overallFilename, string bracketFilename="")
+constexpr EHMLayout<EHMAFTERSEP> EHMSEPARATED{};
+constexpr EHMLayout<EHMAFTERSPACE> EHMSPACED{};
+constexpr EHMLayout<EHMAFTERSPACES> EHMTWOSPACED{};
+constexpr EHMLayout<EHMAFTERLINE> EHMENDLINE{};
+constexpr EHMLayout<EHMAFTERLINEREST> EHMENDLINEREST{};
+constexpr EHMLayout<EHMAFTERRECORD> EHMENDRECORD{};
+constexpr EHMLayout<EHMSIGNPAD> EHMSIGNPADDED{};
+
+// Whether a text field's values repeat enough across players to be stored once each
+enum TextStorage
 {
-	ofstream outputFile(outputFilename.c_str());
+	TEXTUNIQUE,
+	TEXTSHARED
+};
 
-	outputFile.precision(2);
-	outputFile.setf(ios::fixed);
+// How a text field is laid out in players.ehm
+enum EHMText
+{
+	EHMTEXTLINE,
+	// up to the next space, which is written after it
+	EHMTEXTWORD,
+	// a line written twice and read once
+	EHMTEXTTWICE
+};
 
-	double minWeight = 0.5;
-	double maxWeight = 0.5;
+/*
+ * A date counted in twelfths of a day, with 365 day years and months of a
+ * twelfth of a year, so that a difference of YEARUNITS is exactly one year
+ * of age and age thresholds are integer comparisons.
+ */
+const int64_t YEARUNITS = 12*365;
 
-	if(!overallFilename.empty())
-	{
-		ifstream overallFile(overallFilename.c_str());
-		overallFile >> maxWeight;
-		overallFile >> minWeight;
-		overallFile.close();
-	}
+int64_t dateOrdinal(int year, int month, int day)
+{
+	return YEARUNITS*year + 365*int64_t(month) + 12*int64_t(day);
+}
 
-	PlayerRater rater(maxWeight,minWeight);
+/*
+ * Column store for a whole player file: one contiguous array per field, with
+ * all text in a single arena. The parsers append rows here directly and the
+ * cap and salary scans read only the columns they need. Both file formats
+ * are read and written through one record schema, forEachField.
+ */
+class PlayerTable
+{
+	private:
+		/*
+		 * Attributes go: sh pl st ch po hi sk en pe fa le sr fi (13 total)
+		 */
+		static const int STATS = 13;
+		static const char SEP = ',';
 
-	outputFile << "OV\\SAL\t";
-	for(double currentSalary = 400000; currentSalary<9000000; currentSalary+=400000) outputFile << currentSalary/1.e6 << "\t";
-	outputFile << endl;
+		vector<int> ratings[STATS];
+		vector<int> ceilings[STATS];
+
+		vector<int> pot;
+		vector<int> con;
+		vector<int> gre;
+		vector<int> click;
+		vector<int> team;
+		vector<int> position;
+		vector<int> country;
+		vector<int> hand;
+		vector<int> byear;
+		vector<int> bday;
+		vector<int> bmonth;
+		vector<caphit> salary;
+		vector<int> years;
+		vector<int> draftyear;
+		vector<int> draftedby;
+		vector<int> draftround;
+		vector<int> rights;
+
+		vector<TextSpan> dashcode;
+		vector<TextSpan> firstName;
+		vector<TextSpan> lastName;
+		vector<TextSpan> performance;
+
+		vector<int> thisweek[NPERFORMANCE];
+		vector<int> thismonth[NPERFORMANCE];
+		vector<int> records[NRECORDS];
+		vector<int> options[NOPTIONS];
+		vector<int> status[NSTATUSES];
+		vector<TextSpan> scout1;
+		vector<TextSpan> scout2;
+		vector<TextSpan> scout3;
+		vector<int> attitude;
+		vector<int> altpos;
+		vector<int> nhlrights;
+		vector<int> injuryprone;
+		vector<int> draftedoverall;
+		vector<int> misc[NMISC];
+		vector<int> height;
+		vector<int> weight;
+		vector<int> orgstatus;
+		vector<int> streaks[NSTREAKS];
+		vector<TextSpan> draftedstatus;
+		vector<TextSpan> EHMversion;
+
+		string text;
+		size_t rows;
+
+		/*
+		 * Spans of the shared (TEXTSHARED) strings already in text, by hash,
+		 * with open addressing over a power of two at most half full. It isn't
+		 * saved in snapshots or carried over by append, so strings are only
+		 * shared within the table (or chunk) that parsed them.
+		 */
+		struct SharedSlot
+		{
+			TextSpan span;
+			uint32_t hash;
+		};
+		vector<SharedSlot> sharedSlots;
+		size_t nshared;
 
-	bool useBrackets = !bracketFilename.empty();
-	SalaryBrackets brackets(useBrackets);
+		static const uint32_t NOSPAN = uint32_t(-1);
 
-	if(useBrackets)
-	{
-		ifstream bracketFile(bracketFilename.c_str());
-		brackets.initialize(bracketFile);
-		bracketFile.close();
-	}
+		TextSpan addText(const char * begin, size_t length)
+		{
+			TextSpan span = {uint32_t(text.size()), uint32_t(length)};
+			text.append(begin, length);
+			return span;
+		}
 
-	for(double overall = 65; overall <= 90; overall+=2)
-	{
-		outputFile << overall << "\t";
-		for(double currentSalary = 400000; currentSalary<9000000; currentSalary+=400000)
+		TextSpan addSharedText(const char * begin, size_t length)
 		{
-			if(useBrackets)
+			if(2*(nshared + 1) > sharedSlots.size())
 			{
-				outputNewSalaryInfo(currentSalary,overall,outputFile,brackets);
+				vector<SharedSlot> old;
+				old.swap(sharedSlots);
+				SharedSlot empty = {{NOSPAN, 0}, 0};
+				sharedSlots.assign(max<size_t>(64, 2*old.size()), empty);
+				for(size_t i = 0; i < old.size(); i++)
+				{
+					if(old[i].span.offset == NOSPAN) continue;
+					size_t slot = old[i].hash & (sharedSlots.size() - 1);
+					while(sharedSlots[slot].span.offset != NOSPAN) slot = (slot + 1) & (sharedSlots.size() - 1);
+					sharedSlots[slot] = old[i];
+				}
 			}
-			else
+
+			const uint32_t hash = uint32_t(hashBytes(begin, length));
+			size_t slot = hash & (sharedSlots.size() - 1);
+			for(; sharedSlots[slot].span.offset != NOSPAN; slot = (slot + 1) & (sharedSlots.size() - 1))
 			{
-				outputNewSalaryInfo(currentSalary,overall,outputFile);
+				const SharedSlot & shared = sharedSlots[slot];
+				if(shared.hash == hash && shared.span.length == length &&
+					memcmp(text.data() + shared.span.offset, begin, length) == 0) return shared.span;
 			}
-			outputFile << "\t";
+			sharedSlots[slot].span = addText(begin, length);
+			sharedSlots[slot].hash = hash;
+			nshared++;
+			return sharedSlots[slot].span;
+		}
+
+		TextView getText(const TextSpan & span) const
+		{
+			TextView view = {text.data() + span.offset, span.length};
+			return view;
+		}
+
+		template <typename Source> void addText(Source & source, void (Source::*read)(const char * &, size_t &),
+			vector<TextSpan> & column, TextStorage storage)
+		{
+			const char * begin; size_t length;
+			(source.*read)(begin, length);
+			column.push_back(storage == TEXTSHARED ? addSharedText(begin, length) : addText(begin, length));
+		}
+
+		// Calls visitor with a pointer to every column (or array of columns) member
+		template <typename Visitor> static void forEachColumn(Visitor & visitor)
+		{
+			visitor(&PlayerTable::ratings); visitor(&PlayerTable::ceilings);
+			visitor(&PlayerTable::pot); visitor(&PlayerTable::con); visitor(&PlayerTable::gre);
+			visitor(&PlayerTable::click); visitor(&PlayerTable::team); visitor(&PlayerTable::position);
+			visitor(&PlayerTable::country); visitor(&PlayerTable::hand); visitor(&PlayerTable::byear);
+			visitor(&PlayerTable::bday); visitor(&PlayerTable::bmonth); visitor(&PlayerTable::salary);
+			visitor(&PlayerTable::years); visitor(&PlayerTable::draftyear); visitor(&PlayerTable::draftedby);
+			visitor(&PlayerTable::draftround); visitor(&PlayerTable::rights);
+			visitor(&PlayerTable::dashcode); visitor(&PlayerTable::firstName); visitor(&PlayerTable::lastName);
+			visitor(&PlayerTable::performance);
+			visitor(&PlayerTable::thisweek); visitor(&PlayerTable::thismonth); visitor(&PlayerTable::records);
+			visitor(&PlayerTable::options); visitor(&PlayerTable::status);
+			visitor(&PlayerTable::scout1); visitor(&PlayerTable::scout2); visitor(&PlayerTable::scout3);
+			visitor(&PlayerTable::attitude); visitor(&PlayerTable::altpos); visitor(&PlayerTable::nhlrights);
+			visitor(&PlayerTable::injuryprone); visitor(&PlayerTable::draftedoverall); visitor(&PlayerTable::misc);
+			visitor(&PlayerTable::height); visitor(&PlayerTable::weight); visitor(&PlayerTable::orgstatus);
+			visitor(&PlayerTable::streaks); visitor(&PlayerTable::draftedstatus); visitor(&PlayerTable::EHMversion);
+		}
+
+		struct Reserve
+		{
+			PlayerTable & table;
+			size_t nplayers;
+
+			Reserve(PlayerTable & iTable, size_t iNplayers) : table(iTable), nplayers(iNplayers)
+			{
+				;
+			}
+
+			template <typename T> void operator()(vector<T> PlayerTable::*column)
+			{
+				(table.*column).reserve(nplayers);
+			}
+
+			template <typename T, size_t N> void operator()(vector<T> (PlayerTable::*columns)[N])
+			{
+				for(size_t i = 0; i < N; i++) (table.*columns)[i].reserve(nplayers);
+			}
+		};
+
+		struct RowBytes
+		{
+			uint32_t bytes;
+
+			RowBytes() : bytes(0)
+			{
+				;
+			}
+
+			template <typename T> void operator()(vector<T> PlayerTable::*)
+			{
+				bytes += sizeof(T);
+			}
+
+			template <typename T, size_t N> void operator()(vector<T> (PlayerTable::*)[N])
+			{
+				bytes += N*sizeof(T);
+			}
+		};
+
+		struct Save
+		{
+			const PlayerTable & table;
+			ostream & output;
+
+			Save(const PlayerTable & iTable, ostream & iOutput) : table(iTable), output(iOutput)
+			{
+				;
+			}
+
+			template <typename T> void write(const vector<T> & column)
+			{
+				if(!column.empty()) output.write(reinterpret_cast<const char *>(&column[0]), column.size()*sizeof(T));
+			}
+
+			template <typename T> void operator()(vector<T> PlayerTable::*column)
+			{
+				write(table.*column);
+			}
+
+			template <typename T, size_t N> void operator()(vector<T> (PlayerTable::*columns)[N])
+			{
+				for(size_t i = 0; i < N; i++) write((table.*columns)[i]);
+			}
+		};
+
+		struct Load
+		{
+			PlayerTable & table;
+			const char * data;
+
+			Load(PlayerTable & iTable, const char * iData) : table(iTable), data(iData)
+			{
+				;
+			}
+
+			// The mapped columns needn't be aligned, so they're copied rather than cast
+			template <typename T> void read(vector<T> & column)
+			{
+				column.resize(table.rows);
+				if(table.rows > 0) memcpy(&column[0], data, table.rows*sizeof(T));
+				data += table.rows*sizeof(T);
+			}
+
+			template <typename T> void operator()(vector<T> PlayerTable::*column)
+			{
+				read(table.*column);
+			}
+
+			template <typename T, size_t N> void operator()(vector<T> (PlayerTable::*columns)[N])
+			{
+				for(size_t i = 0; i < N; i++) read((table.*columns)[i]);
+			}
+		};
+
+		struct Append
+		{
+			PlayerTable & table;
+			const PlayerTable & other;
+
+			Append(PlayerTable & iTable, const PlayerTable & iOther) : table(iTable), other(iOther)
+			{
+				;
+			}
+
+			template <typename T> void operator()(vector<T> PlayerTable::*column)
+			{
+				(table.*column).insert((table.*column).end(), (other.*column).begin(), (other.*column).end());
+			}
+
+			template <typename T, size_t N> void operator()(vector<T> (PlayerTable::*columns)[N])
+			{
+				for(size_t i = 0; i < N; i++)
+				{
+					(table.*columns)[i].insert((table.*columns)[i].end(), (other.*columns)[i].begin(), (other.*columns)[i].end());
+				}
+			}
+
+			// other's text is appended after this table's, so its spans move up
+			void operator()(vector<TextSpan> PlayerTable::*column)
+			{
+				vector<TextSpan> & spans = table.*column;
+				size_t first = spans.size();
+				spans.insert(spans.end(), (other.*column).begin(), (other.*column).end());
+				for(size_t i = first; i < spans.size(); i++) spans[i].offset += table.text.size();
+			}
+		};
+
+	public:
+		PlayerTable() : rows(0), nshared(0)
+		{
+			;
+		}
+
+		size_t size() const
+		{
+			return rows;
+		}
+
+		void reserve(size_t nplayers)
+		{
+			Reserve visitor(*this, nplayers);
+			forEachColumn(visitor);
+		}
+
+		// Bytes of column data per row, which changes whenever a column does
+		static uint32_t rowBytes()
+		{
+			RowBytes visitor;
+			forEachColumn(visitor);
+			return visitor.bytes;
+		}
+
+		// Writes the table after header; false if the file couldn't be written
+		bool saveSnapshot(const string & filename, SnapshotHeader header) const
+		{
+			memcpy(header.magic, SNAPSHOTMAGIC, sizeof(header.magic));
+			header.version = SNAPSHOTVERSION;
+			header.rowBytes = rowBytes();
+			header.rows = rows;
+			header.textSize = text.size();
+
+			// written under a temporary name so a reader never sees half a snapshot
+			string tempname = filename + ".tmp";
+			{
+				ofstream file(tempname.c_str(), ios::binary);
+				file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+				Save visitor(*this, file);
+				forEachColumn(visitor);
+				file.write(text.data(), text.size());
+				file.close();
+				if(!file)
+				{
+					DeleteFileA(tempname.c_str());
+					return false;
+				}
+			}
+			return MoveFileExA(tempname.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING);
+		}
+
+		// Replaces the table with a snapshot's, if its header matches expected
+		bool loadSnapshot(const MappedFile & snapshot, const SnapshotHeader & expected)
+		{
+			SnapshotHeader header;
+			if(snapshot.getSize() < sizeof(header)) return false;
+			memcpy(&header, snapshot.begin(), sizeof(header));
+			bool matches = memcmp(header.magic, SNAPSHOTMAGIC, sizeof(header.magic)) == 0 &&
+				header.version == SNAPSHOTVERSION && header.rowBytes == rowBytes() &&
+				header.sourceSize == expected.sourceSize && header.sourceMtime == expected.sourceMtime &&
+				header.sourceHash == expected.sourceHash && header.countLine == expected.countLine &&
+				header.rows == expected.rows &&
+				snapshot.getSize() == sizeof(header) + header.rows*header.rowBytes + header.textSize;
+			if(!matches) return false;
+
+			rows = header.rows;
+			Load visitor(*this, snapshot.begin() + sizeof(header));
+			forEachColumn(visitor);
+			text.assign(visitor.data, header.textSize);
+			return true;
+		}
+
+		// Appends all of other's rows after this table's rows
+		void append(const PlayerTable & other)
+		{
+			Append visitor(*this, other);
+			forEachColumn(visitor);
+			text += other.text;
+			rows += other.rows;
+		}
+
+	private:
+		/*
+		 * The player record, in file order, which is the same for players.ehm
+		 * and the CSV: each call gives a column (or a run of an array of
+		 * columns), its CSV column names and its EHM layout. The parsers and
+		 * writers are visitors over it, so a new field is one line here.
+		 * Records start with a space in players.ehm.
+		 */
+		template <typename Visitor> static void forEachField(Visitor & visitor)
+		{
+			visitor.numbers(&PlayerTable::ratings, 1, 10, "sh,pl,st,ch,po,hi,sk,en,pe,fa", EHMSEPARATED, EHMENDLINE);
+			visitor.numbers(&PlayerTable::ratings, 11, 2, "le,str", EHMSEPARATED, EHMSEPARATED);
+			visitor.number(&PlayerTable::pot, "pot", EHMSEPARATED);
+			visitor.number(&PlayerTable::con, "con", EHMSEPARATED);
+			visitor.number(&PlayerTable::gre, "gre", EHMSEPARATED);
+			visitor.numbers(&PlayerTable::ratings, 0, 1, "fi", EHMSEPARATED, EHMSEPARATED);
+			visitor.number(&PlayerTable::click, "click", EHMSEPARATED);
+			visitor.number(&PlayerTable::team, "team", EHMSEPARATED);
+			visitor.number(&PlayerTable::position, "position", EHMSEPARATED);
+			visitor.number(&PlayerTable::country, "country", EHMSEPARATED);
+			visitor.number(&PlayerTable::hand, "hand", EHMENDLINE);
+			visitor.number(&PlayerTable::byear, "byear", EHMSEPARATED);
+			visitor.number(&PlayerTable::bday, "bday", EHMSEPARATED);
+			visitor.number(&PlayerTable::bmonth, "bmonth", EHMSEPARATED);
+			visitor.number(&PlayerTable::salary, "salary", EHMSEPARATED);
+			visitor.number(&PlayerTable::years, "years", EHMSEPARATED);
+			visitor.number(&PlayerTable::draftyear, "draft_year", EHMSEPARATED);
+			visitor.number(&PlayerTable::draftround, "draft_round", EHMSEPARATED);
+			visitor.number(&PlayerTable::draftedby, "draft_team", EHMSEPARATED);
+			visitor.number(&PlayerTable::rights, "rights", EHMENDLINE);
+			visitor.numbers(&PlayerTable::thisweek, 0, NPERFORMANCE, "thisweek_gp,thisweek_g,thisweek_a,thisweek_gwg",
+				EHMSEPARATED, EHMENDLINE);
+			visitor.numbers(&PlayerTable::thismonth, 0, NPERFORMANCE, "thismonth_gp,thismonth_g,thismonth_a,thismonth_gwg",
+				EHMSEPARATED, EHMENDLINE);
+			visitor.numbers(&PlayerTable::records, 0, NRECORDS, "records_g,records_a,records_p", EHMSEPARATED, EHMSEPARATED);
+			visitor.numbers(&PlayerTable::options, 0, NOPTIONS, "notrade,twoway,option", EHMSEPARATED, EHMENDLINE);
+			visitor.numbers(&PlayerTable::status, 0, NSTATUSES,
+				"status,rookie,offer_status,offer_team,offer_time,injury_status", EHMSEPARATED, EHMENDLINEREST);
+			visitor.text(&PlayerTable::scout1, "scout_1_10", EHMTEXTLINE, TEXTSHARED);
+			visitor.text(&PlayerTable::scout2, "scout_11_20", EHMTEXTLINE, TEXTSHARED);
+			visitor.text(&PlayerTable::scout3, "scout_21_30", EHMTEXTLINE, TEXTSHARED);
+			visitor.numbers(&PlayerTable::misc, 0, NMISC, "streak_g,streak_p,gp,suspension,training",
+				EHMSPACED | EHMSIGNPADDED, EHMTWOSPACED | EHMSIGNPADDED);
+			visitor.number(&PlayerTable::weight, "weight", EHMSEPARATED);
+			visitor.number(&PlayerTable::height, "height", EHMSEPARATED);
+			visitor.number(&PlayerTable::orgstatus, "status_org", EHMENDLINE);
+			visitor.numbers(&PlayerTable::streaks, 0, NSTREAKS,
+				"streak_best_gp,streak_best_gwg,streak_best_p,streak_best_a,streak_best_g", EHMSEPARATED, EHMENDLINEREST);
+			visitor.text(&PlayerTable::dashcode, "unused", EHMTEXTLINE, TEXTUNIQUE);
+			visitor.text(&PlayerTable::firstName, "name_first", EHMTEXTWORD, TEXTUNIQUE);
+			visitor.text(&PlayerTable::lastName, "name_last", EHMTEXTLINE, TEXTUNIQUE);
+			visitor.text(&PlayerTable::performance, "performance", EHMTEXTLINE, TEXTSHARED);
+			visitor.text(&PlayerTable::draftedstatus, "acquired", EHMTEXTLINE, TEXTSHARED);
+			visitor.fixedWidth(&PlayerTable::ceilings, 3, "ceil_fi,ceil_sh,ceil_pl,ceil_st,ceil_ch,ceil_po,ceil_hi,"
+				"ceil_sk,ceil_en,ceil_pe,ceil_fa,ceil_le,ceil_str");
+			visitor.text(&PlayerTable::EHMversion, "version", EHMTEXTTWICE, TEXTSHARED);
+			visitor.number(&PlayerTable::attitude, "attitude", EHMSEPARATED | EHMSIGNPADDED);
+			visitor.number(&PlayerTable::altpos, "position_alt", EHMSEPARATED);
+			visitor.number(&PlayerTable::nhlrights, "rights_2", EHMSEPARATED);
+			visitor.number(&PlayerTable::injuryprone, "injury_prone", EHMSEPARATED);
+			visitor.number(&PlayerTable::draftedoverall, "draft_overall", EHMENDRECORD);
+		}
+
+		struct ParseEHM
+		{
+			PlayerTable & table;
+			EHMTokenizer & tokens;
+
+			ParseEHM(PlayerTable & iTable, EHMTokenizer & iTokens) : table(iTable), tokens(iTokens)
+			{
+				;
+			}
+
+			template <int Format, typename T> void read(vector<T> & column)
+			{
+				column.push_back(tokens.readInt<T>());
+				// the rest of the line being the extra space before its newline
+				if((Format & EHMAFTERMASK) == EHMAFTERLINEREST) tokens.skipLine();
+			}
+
+			template <typename T, int Format> void number(vector<T> PlayerTable::*column, const char *, EHMLayout<Format>)
+			{
+				read<Format>(table.*column);
+			}
+
+			template <typename T, size_t N, int Format, int Last> void numbers(vector<T> (PlayerTable::*columns)[N],
+				size_t first, size_t count, const char *, EHMLayout<Format>, EHMLayout<Last>)
+			{
+				for(size_t i = first; i + 1 < first + count; i++) read<Format>((table.*columns)[i]);
+				read<Last>((table.*columns)[first + count - 1]);
+			}
+
+			void text(vector<TextSpan> PlayerTable::*column, const char *, EHMText layout, TextStorage storage)
+			{
+				if(layout == EHMTEXTWORD)
+				{
+					table.addText(tokens, &EHMTokenizer::readWord, table.*column, storage);
+					// explicitly skip the space after it
+					tokens.get();
+					return;
+				}
+				table.addText(tokens, &EHMTokenizer::readLine, table.*column, storage);
+				if(layout == EHMTEXTTWICE) tokens.skipLine();
+			}
+
+			template <size_t N> void fixedWidth(vector<int> (PlayerTable::*columns)[N], size_t width, const char *)
+			{
+				const char * line; size_t length;
+				tokens.readLine(line, length);
+				for(size_t i = 0; i < N; i++)
+				{
+					size_t offset = min(i*width, length);
+					(table.*columns)[i].push_back(parseFixedWidth(line + offset, min(width, length - offset)));
+				}
+			}
+		};
+
+		struct ParseCSV
+		{
+			PlayerTable & table;
+			CSVReader & row;
+
+			ParseCSV(PlayerTable & iTable, CSVReader & iRow) : table(iTable), row(iRow)
+			{
+				;
+			}
+
+			template <typename T, typename Layout> void number(vector<T> PlayerTable::*column, const char *, Layout)
+			{
+				(table.*column).push_back(row.readInt<T>());
+			}
+
+			template <typename T, size_t N, typename Layout, typename Last> void numbers(
+				vector<T> (PlayerTable::*columns)[N], size_t first, size_t count, const char *, Layout, Last)
+			{
+				for(size_t i = first; i < first + count; i++) (table.*columns)[i].push_back(row.readInt<T>());
+			}
+
+			void text(vector<TextSpan> PlayerTable::*column, const char *, EHMText, TextStorage storage)
+			{
+				table.addText(row, &CSVReader::readString, table.*column, storage);
+			}
+
+			template <size_t N> void fixedWidth(vector<int> (PlayerTable::*columns)[N], size_t, const char *)
+			{
+				for(size_t i = 0; i < N; i++) (table.*columns)[i].push_back(row.readInt<int>());
+			}
+		};
+
+		struct WriteEHM
+		{
+			const PlayerTable & table;
+			size_t row;
+			OutputBuffer & out;
+
+			WriteEHM(const PlayerTable & iTable, size_t iRow, OutputBuffer & iOut) : table(iTable), row(iRow), out(iOut)
+			{
+				;
+			}
+
+			template <int Format, typename T> void write(T value)
+			{
+				if((Format & EHMSIGNPAD) && value >= 0) out << ' ';
+				out.appendInt(value);
+				switch(Format & EHMAFTERMASK)
+				{
+					case EHMAFTERSEP: out << EHMSEP; break;
+					case EHMAFTERSPACE: out << ' '; break;
+					case EHMAFTERSPACES: out << "  "; break;
+					case EHMAFTERLINE: out << " \n "; break;
+					default: out << " \n"; break;
+				}
+			}
+
+			template <typename T, int Format> void number(vector<T> PlayerTable::*column, const char *, EHMLayout<Format>)
+			{
+				write<Format>((table.*column)[row]);
+			}
+
+			template <typename T, size_t N, int Format, int Last> void numbers(vector<T> (PlayerTable::*columns)[N],
+				size_t first, size_t count, const char *, EHMLayout<Format>, EHMLayout<Last>)
+			{
+				for(size_t i = first; i + 1 < first + count; i++) write<Format>((table.*columns)[i][row]);
+				write<Last>((table.*columns)[first + count - 1][row]);
+			}
+
+			void text(vector<TextSpan> PlayerTable::*column, const char *, EHMText layout, TextStorage)
+			{
+				const TextSpan & span = (table.*column)[row];
+				out.append(table.text.data() + span.offset, span.length);
+				out << (layout == EHMTEXTWORD ? ' ' : '\n');
+				if(layout == EHMTEXTTWICE)
+				{
+					out.append(table.text.data() + span.offset, span.length);
+					out << '\n';
+				}
+			}
+
+			template <size_t N> void fixedWidth(vector<int> (PlayerTable::*columns)[N], size_t width, const char *)
+			{
+				for(size_t i = 0; i < N; i++) out.appendInt((table.*columns)[i][row], width);
+				out << '\n';
+			}
+		};
+
+		struct WriteCSV
+		{
+			const PlayerTable & table;
+			size_t row;
+			OutputBuffer & out;
+
+			WriteCSV(const PlayerTable & iTable, size_t iRow, OutputBuffer & iOut) : table(iTable), row(iRow), out(iOut)
+			{
+				;
+			}
+
+			template <typename T, typename Layout> void number(vector<T> PlayerTable::*column, const char *, Layout)
+			{
+				out.appendInt((table.*column)[row]);
+				out << SEP;
+			}
+
+			template <typename T, size_t N, typename Layout, typename Last> void numbers(
+				vector<T> (PlayerTable::*columns)[N], size_t first, size_t count, const char *, Layout, Last)
+			{
+				for(size_t i = first; i < first + count; i++)
+				{
+					out.appendInt((table.*columns)[i][row]);
+					out << SEP;
+				}
+			}
+
+			void text(vector<TextSpan> PlayerTable::*column, const char *, EHMText, TextStorage)
+			{
+				const TextSpan & span = (table.*column)[row];
+				out.append(table.text.data() + span.offset, span.length);
+				out << SEP;
+			}
+
+			template <size_t N> void fixedWidth(vector<int> (PlayerTable::*columns)[N], size_t, const char *)
+			{
+				for(size_t i = 0; i < N; i++)
+				{
+					out.appendInt((table.*columns)[i][row]);
+					out << SEP;
+				}
+			}
+		};
+
+		struct CSVNames
+		{
+			string names;
+
+			void add(const char * list, size_t count)
+			{
+				size_t added = 0;
+				for(const char * name = list; ; ++added)
+				{
+					const char * end = strchr(name, ',');
+					names += "\"" + (end == NULL ? string(name) : string(name, end)) + "\",";
+					if(end == NULL) break;
+					name = end + 1;
+				}
+				assert(added + 1 == count);
+			}
+
+			template <typename T, typename Layout> void number(vector<T> PlayerTable::*, const char * name, Layout)
+			{
+				add(name, 1);
+			}
+
+			template <typename T, size_t N, typename Layout, typename Last> void numbers(vector<T> (PlayerTable::*)[N],
+				size_t, size_t count, const char * list, Layout, Last)
+			{
+				add(list, count);
+			}
+
+			void text(vector<TextSpan> PlayerTable::*, const char * name, EHMText, TextStorage)
+			{
+				add(name, 1);
+			}
+
+			template <size_t N> void fixedWidth(vector<int> (PlayerTable::*)[N], size_t, const char * list)
+			{
+				add(list, N);
+			}
+		};
+
+	public:
+		// Parses one players.ehm record
+		void appendEHM(EHMTokenizer & tokens)
+		{
+			ParseEHM visitor(*this, tokens);
+			forEachField(visitor);
+			rows++;
+		}
+
+		// Parses the current CSV row; anything after the schema's columns (i.e. the id column) is ignored
+		void appendCSV(CSVReader & row)
+		{
+			ParseCSV visitor(*this, row);
+			forEachField(visitor);
+			rows++;
+		}
+
+		void outputDataEHM(size_t row, OutputBuffer & out) const
+		{
+			out << ' ';
+			WriteEHM visitor(*this, row, out);
+			forEachField(visitor);
+		}
+
+		// The CSV row ends with id, the player's row in the file converted
+		void outputDataCSV(size_t row, OutputBuffer & out, size_t id) const
+		{
+			WriteCSV visitor(*this, row, out);
+			forEachField(visitor);
+			out << id << '\n';
+		}
+
+		// Quoted column names of the CSV, id included
+		static string csvColumns()
+		{
+			CSVNames visitor;
+			forEachField(visitor);
+			return visitor.names + "\"id\"";
+		}
+
+		int getContractLength(size_t row) const
+		{
+			return years[row];
+		}
+
+		caphit getSalary(size_t row) const
+		{
+			return max(salary[row],MINCAPHIT);
+		}
+
+		int getTeam(size_t row) const
+		{
+			return team[row];
+		}
+
+		TextView getFirstName(size_t row) const
+		{
+			return getText(firstName[row]);
+		}
+
+		TextView getLastName(size_t row) const
+		{
+			return getText(lastName[row]);
+		}
+
+		int getRating(size_t row, int rating) const
+		{
+			assert(rating < STATS);
+			return ratings[rating][row];
+		}
+
+		// One rating of every player, in row order
+		const int * getRatings(int rating) const
+		{
+			assert(rating < STATS);
+			return ratings[rating].data();
+		}
+
+		const int * getConsistencies() const
+		{
+			return con.data();
+		}
+
+		int getRights(size_t row) const
+		{
+			return rights[row];
+		}
+
+		int getConsistency(size_t row) const
+		{
+			return con[row];
+		}
+
+		// Identity of a player across files: name, birth date and draft
+		uint64_t hashKey(size_t row) const
+		{
+			const int numbers[7] = {byear[row], bmonth[row], bday[row],
+				draftyear[row], draftround[row], draftedby[row], 0};
+			uint64_t hash = hashBytes(reinterpret_cast<const char *>(numbers), sizeof(numbers));
+			hash ^= hashBytes(text.data() + firstName[row].offset, firstName[row].length) * 31;
+			hash ^= hashBytes(text.data() + lastName[row].offset, lastName[row].length) * 37;
+			return hash;
+		}
+
+		bool sameKey(size_t row, const PlayerTable & other, size_t otherRow) const
+		{
+			const TextSpan & first = firstName[row];
+			const TextSpan & otherFirst = other.firstName[otherRow];
+			const TextSpan & last = lastName[row];
+			const TextSpan & otherLast = other.lastName[otherRow];
+			return byear[row] == other.byear[otherRow] && bmonth[row] == other.bmonth[otherRow] &&
+				bday[row] == other.bday[otherRow] && draftyear[row] == other.draftyear[otherRow] &&
+				draftround[row] == other.draftround[otherRow] && draftedby[row] == other.draftedby[otherRow] &&
+				first.length == otherFirst.length && last.length == otherLast.length &&
+				memcmp(text.data() + first.offset, other.text.data() + otherFirst.offset, first.length) == 0 &&
+				memcmp(text.data() + last.offset, other.text.data() + otherLast.offset, last.length) == 0;
+		}
+
+		int64_t getBirthOrdinal(size_t row) const
+		{
+			return dateOrdinal(byear[row], bmonth[row], bday[row]);
+		}
+
+		// whether the player is age or older on a certain date. No it's not exact, no I don't care.
+		bool isAtLeast(size_t row, int age, int year, int month, int day) const
+		{
+			return dateOrdinal(year, month, day) - getBirthOrdinal(row) >= age*YEARUNITS;
+		}
+};
+
+/*
+ * What a run spent its time on, for --stats: wall and CPU time, bytes and
+ * records of each phase (phases of the same name add up, e.g. across batch
+ * jobs), and seconds per team for the per-team phases, written as JSON. CPU
+ * time is the whole process's, so parallel phases count all their threads.
+ * Functions take a RunStats pointer that's NULL when stats are off.
+ */
+class RunStats
+{
+	public:
+		struct Phase
+		{
+			string name;
+			double wall;
+			double cpu;
+			uint64_t bytesRead;
+			uint64_t bytesWritten;
+			uint64_t records;
+		};
+
+	private:
+		mutex lock;
+		vector<Phase> phases;
+		map<string, vector<double> > teamTimes;
+		chrono::steady_clock::time_point start;
+		double cpuStart;
+
+	public:
+		RunStats() : start(chrono::steady_clock::now()), cpuStart(cpuSeconds())
+		{
+			;
+		}
+
+		static double cpuSeconds()
+		{
+			FILETIME creation, exit, kernel, user;
+			if(!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) return 0;
+			uint64_t ticks = ((uint64_t(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime) +
+				((uint64_t(user.dwHighDateTime) << 32) | user.dwLowDateTime);
+			return ticks*1e-7;
+		}
+
+		void addPhase(const Phase & phase)
+		{
+			lock_guard<mutex> guard(lock);
+			for(size_t i = 0; i < phases.size(); i++)
+			{
+				if(phases[i].name == phase.name)
+				{
+					phases[i].wall += phase.wall;
+					phases[i].cpu += phase.cpu;
+					phases[i].bytesRead += phase.bytesRead;
+					phases[i].bytesWritten += phase.bytesWritten;
+					phases[i].records += phase.records;
+					return;
+				}
+			}
+			phases.push_back(phase);
+		}
+
+		void addTeamTime(const string & phase, size_t team, double seconds)
+		{
+			lock_guard<mutex> guard(lock);
+			vector<double> & times = teamTimes[phase];
+			times.resize(NTEAMS);
+			times[team] += seconds;
+		}
+
+		void write(ostream & out)
+		{
+			lock_guard<mutex> guard(lock);
+			out << "{\n  \"wall_s\": " << chrono::duration<double>(chrono::steady_clock::now() - start).count() <<
+				",\n  \"cpu_s\": " << cpuSeconds() - cpuStart << ",\n  \"phases\": [";
+			for(size_t i = 0; i < phases.size(); i++)
+			{
+				const Phase & phase = phases[i];
+				out << (i ? "," : "") << "\n    {\"name\": \"" << phase.name << "\", \"wall_s\": " << phase.wall <<
+					", \"cpu_s\": " << phase.cpu << ", \"bytes_read\": " << phase.bytesRead <<
+					", \"bytes_written\": " << phase.bytesWritten << ", \"records\": " << phase.records << "}";
+			}
+			out << "\n  ],\n  \"teams\": [";
+			for(size_t team = 0; team < NTEAMS && !teamTimes.empty(); team++)
+			{
+				out << (team ? "," : "") << "\n    {\"team\": \"" << TEAMNAMES[team] << "\"";
+				map<string, vector<double> >::const_iterator it;
+				for(it = teamTimes.begin(); it != teamTimes.end(); ++it)
+				{
+					out << ", \"" << it->first << "_s\": " << it->second[team];
+				}
+				out << "}";
+			}
+			out << "\n  ]\n}" << endl;
+		}
+};
+
+// Times a phase into stats (if any) from construction to destruction; the counts are filled in as it goes
+class PhaseTimer
+{
+	private:
+		RunStats * stats;
+		RunStats::Phase phase;
+		chrono::steady_clock::time_point start;
+		double cpuStart;
+
+		PhaseTimer(const PhaseTimer &) = delete;
+		PhaseTimer & operator=(const PhaseTimer &) = delete;
+
+	public:
+		uint64_t & bytesRead;
+		uint64_t & bytesWritten;
+		uint64_t & records;
+
+		PhaseTimer(RunStats * iStats, const char * name) : stats(iStats), start(chrono::steady_clock::now()),
+			cpuStart(iStats != NULL ? RunStats::cpuSeconds() : 0), bytesRead(phase.bytesRead),
+			bytesWritten(phase.bytesWritten), records(phase.records)
+		{
+			phase.name = name;
+			phase.bytesRead = phase.bytesWritten = phase.records = 0;
+		}
+
+		~PhaseTimer()
+		{
+			stop();
+		}
+
+		// Ends the phase early; it's only recorded once
+		void stop()
+		{
+			if(stats == NULL) return;
+			phase.wall = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			phase.cpu = RunStats::cpuSeconds() - cpuStart;
+			stats->addPhase(phase);
+			stats = NULL;
+		}
+};
+
+// Size of a file in bytes, 0 if it can't be read
+uint64_t getFileSize(const string & filename)
+{
+	uint64_t size = 0;
+	uint64_t mtime = 0;
+	getFileStamp(filename, size, mtime);
+	return size;
+}
+
+/*
+ * Runs task(0) ... task(ntasks-1) on up to nthreads threads, each thread
+ * taking the next task as it finishes one. If tasks throw, the exception of
+ * the lowest numbered one is rethrown once they've all finished.
+ */
+template<typename Task>
+void runTasks(size_t ntasks, unsigned int nthreads, Task task)
+{
+	vector<exception_ptr> errors(ntasks);
+	atomic<size_t> next(0);
+	auto worker = [&]()
+	{
+		for(size_t i = next++; i < ntasks; i = next++)
+		{
+			try
+			{
+				task(i);
+			}
+			catch(...)
+			{
+				errors[i] = current_exception();
+			}
+		}
+	};
+
+	nthreads = min<size_t>(nthreads, ntasks);
+	vector<thread> workers;
+	for(unsigned int i = 1; i < nthreads; i++) workers.push_back(thread(worker));
+	worker();
+	for(size_t i = 0; i < workers.size(); i++) workers[i].join();
+
+	for(size_t i = 0; i < ntasks; i++)
+	{
+		if(errors[i]) rethrow_exception(errors[i]);
+	}
+}
+
+/*
+ * Parses nplayers records into table, starting at the tokenizer's position.
+ * With more than one thread, a first pass counts lines to find where each
+ * chunk of records starts (every record after the first is EHMRECORDLINES
+ * long), each chunk is parsed into its own table on a worker thread, and the
+ * chunks are appended in order. If any chunk doesn't end where the next one
+ * starts the file isn't laid out as expected, so the rest is parsed serially
+ * instead; either way the table matches a serial parse.
+ */
+void parseEHMRecords(EHMTokenizer & tokens, size_t nplayers, PlayerTable & table, unsigned int nthreads)
+{
+	table.reserve(table.size() + nplayers);
+
+	// Not worth the threads for small files
+	const size_t MINCHUNK = 256;
+	nthreads = min<size_t>(nthreads, nplayers/MINCHUNK);
+	if(nthreads <= 1)
+	{
+		for(size_t i = 0; i < nplayers; i++) table.appendEHM(tokens);
+		return;
+	}
+
+	// The first record can be irregular (see the start of season file), so
+	// it's parsed serially and the index starts on the line after it
+	table.appendEHM(tokens);
+	const char * end = tokens.end();
+	const char * lineStart = static_cast<const char *>(memchr(tokens.position(), '\n', end - tokens.position()));
+	lineStart = lineStart == NULL ? end : lineStart + 1;
+
+	const size_t nrecords = nplayers - 1;
+	const size_t chunkSize = (nrecords + nthreads - 1)/nthreads;
+	vector<const char *> chunkStarts;
+	vector<size_t> chunkFirst;
+	for(size_t record = 0; record < nrecords && lineStart < end; record++)
+	{
+		if(record % chunkSize == 0)
+		{
+			chunkStarts.push_back(lineStart);
+			chunkFirst.push_back(record);
+		}
+		for(size_t line = 0; line < EHMRECORDLINES && lineStart < end; line++)
+		{
+			const char * eol = static_cast<const char *>(memchr(lineStart, '\n', end - lineStart));
+			lineStart = eol == NULL ? end : eol + 1;
+		}
+	}
+	chunkFirst.push_back(nrecords);
+
+	const size_t nchunks = chunkStarts.size();
+	vector<PlayerTable> chunks(nchunks);
+	vector<const char *> chunkEnds(nchunks);
+	vector<thread> workers;
+	for(size_t chunk = 0; chunk < nchunks; chunk++)
+	{
+		workers.push_back(thread([&, chunk]()
+		{
+			EHMTokenizer chunkTokens(chunkStarts[chunk], end);
+			size_t chunkRecords = chunkFirst[chunk+1] - chunkFirst[chunk];
+			chunks[chunk].reserve(chunkRecords);
+			for(size_t i = 0; i < chunkRecords; i++) chunks[chunk].appendEHM(chunkTokens);
+			chunkEnds[chunk] = chunkTokens.position();
+		}));
+	}
+	for(size_t chunk = 0; chunk < nchunks; chunk++) workers[chunk].join();
+
+	// Only whitespace may separate the end of one chunk from the start of the next
+	bool aligned = nchunks > 0;
+	for(size_t chunk = 0; aligned && chunk + 1 < nchunks; chunk++)
+	{
+		for(const char * c = chunkEnds[chunk]; aligned && c < chunkStarts[chunk+1]; ++c)
+		{
+			aligned = *c == ' ' || (*c >= '\t' && *c <= '\r');
+		}
+	}
+
+	if(aligned)
+	{
+		for(size_t chunk = 0; chunk < nchunks; chunk++) table.append(chunks[chunk]);
+		tokens.seek(chunkEnds[nchunks-1]);
+	}
+	else
+	{
+		for(size_t i = 0; i < nrecords; i++) table.appendEHM(tokens);
+	}
+}
+
+/*
+ * Reads a players.ehm file into table: the player count line first if
+ * countLine is set (in which case nplayers comes from it), then nplayers
+ * records. With useSnapshot, the parsed table is kept in <filename>.snap and
+ * later runs load that instead while the file is unchanged. Returns nplayers.
+ */
+size_t loadPlayerFile(const string & filename, bool countLine, size_t nplayers, PlayerTable & table,
+	unsigned int nthreads, bool useSnapshot)
+{
+	MappedFile input(filename);
+	EHMTokenizer tokens(input.begin(), input.end());
+	if(countLine) nplayers = tokens.readInt<size_t>();
+
+	if(!useSnapshot)
+	{
+		parseEHMRecords(tokens, nplayers, table, nthreads);
+		return nplayers;
+	}
+
+	SnapshotHeader key;
+	memset(&key, 0, sizeof(key));
+	getFileStamp(filename, key.sourceSize, key.sourceMtime);
+	key.sourceHash = hashBytes(input.begin(), input.getSize());
+	key.countLine = countLine;
+	key.rows = nplayers;
+
+	// the same file can be read both ways (e.g. on the first day of a season)
+	string snapshotFilename = filename + (countLine ? ".snap" : ".raw.snap");
+	{
+		MappedFile snapshot(snapshotFilename);
+		PlayerTable cached;
+		if(cached.loadSnapshot(snapshot, key))
+		{
+			table.append(cached);
+			return nplayers;
+		}
+	}
+
+	PlayerTable parsed;
+	parseEHMRecords(tokens, nplayers, parsed, nthreads);
+	if(!parsed.saveSnapshot(snapshotFilename, key))
+	{
+		cerr << "Warning: couldn't write player snapshot " << snapshotFilename << endl;
+	}
+	table.append(parsed);
+	return nplayers;
+}
+
+// Sorts row indices of a PlayerTable by descending salary
+struct HigherSalary
+{
+	const PlayerTable & table;
+
+	HigherSalary(const PlayerTable & iTable) : table(iTable)
+	{
+		;
+	}
+
+	bool operator()(size_t i, size_t j) const
+	{
+		return table.getSalary(i) > table.getSalary(j);
+	}
+};
+
+/*
+ * Raises by overall and salary bracket. The file gives the number of OV
+ * brackets and their thresholds, then for each OV bracket its number of
+ * salary brackets, their thresholds in millions, and the raise of each in
+ * percent. Everything lives in one table, a row per OV bracket holding its
+ * salary thresholds followed by its raises, found through rows. Thresholds
+ * must go up, so a bracket is the count of thresholds at or below a value.
+ */
+class SalaryBrackets
+{
+	private:
+		vector<int> ovbrackets;
+		// start of each OV bracket's row in table, and the end of the last
+		vector<size_t> rows;
+		vector<double> table;
+
+		size_t getOvbracket(double overall) const
+		{
+			return upper_bound(ovbrackets.begin(), ovbrackets.end(), overall) - ovbrackets.begin();
+		}
+
+		// Salary thresholds are few, so they're counted without branching rather than searched
+		static size_t getSalaryBracket(const double * thresholds, size_t nthresholds, double salary)
+		{
+			size_t salarybracket = 0;
+			for(size_t i = 0; i < nthresholds; i++) salarybracket += !(salary < thresholds[i]);
+			return salarybracket;
+		}
+
+	public:
+		void initialize(istream & inputStream)
+		{
+			if(!rows.empty()) return;
+
+			int novbrackets = 0;
+			inputStream >> novbrackets;
+			if(!inputStream || novbrackets < 1)
+			{
+				throw runtime_error("Error! Salary brackets need at least one OV bracket; aborting.");
+			}
+			ovbrackets.resize(novbrackets-1);
+			for(int ovbracket = 0; ovbracket < novbrackets-1; ovbracket++)
+			{
+				inputStream >> ovbrackets[ovbracket];
+			}
+
+			rows.push_back(0);
+			for(int ovbracket = 0; ovbracket < novbrackets; ovbracket++)
+			{
+				int nsalarybrackets = 0;
+				inputStream >> nsalarybrackets;
+				if(!inputStream || nsalarybrackets < 1)
+				{
+					throw runtime_error("Error! OV bracket " + to_string(ovbracket+1) +
+						" needs at least one salary bracket; aborting.");
+				}
+				for(int salarybracket = 0; salarybracket < 2*nsalarybrackets-1; salarybracket++)
+				{
+					double value = 0;
+					inputStream >> value;
+					table.push_back(salarybracket < nsalarybrackets-1 ? value*1.e6 : value);
+				}
+				rows.push_back(table.size());
+			}
+
+			if(inputStream.fail())
+			{
+				throw runtime_error("Error! Salary brackets file ends early; aborting.");
+			}
+			bool sorted = is_sorted(ovbrackets.begin(), ovbrackets.end());
+			for(size_t ovbracket = 0; ovbracket + 1 < rows.size(); ovbracket++)
+			{
+				const size_t nthresholds = (rows[ovbracket+1] - rows[ovbracket])/2;
+				sorted = sorted && is_sorted(&table[rows[ovbracket]], &table[rows[ovbracket]] + nthresholds);
+			}
+			if(!sorted)
+			{
+				throw runtime_error("Error! Salary bracket thresholds must go up; aborting.");
+			}
+		}
+
+		double getSalary(double initialSalary, double overall) const
+		{
+			const size_t ovbracket = getOvbracket(overall);
+			const double * row = &table[rows[ovbracket]];
+			const size_t nthresholds = (rows[ovbracket+1] - rows[ovbracket])/2;
+
+			double raise = row[nthresholds + getSalaryBracket(row, nthresholds, initialSalary)];
+
+			return initialSalary * (1.0 + raise/100.);
+		}
+
+		// getSalary for each of n salary and overall pairs
+		void getSalaries(const double * salaries, const double * overalls, double * out, size_t n) const
+		{
+			for(size_t i = 0; i < n; i++) out[i] = getSalary(salaries[i], overalls[i]);
+		}
+
+		// getSalary for each of n salaries at one overall
+		void getSalaries(double overall, const double * salaries, double * out, size_t n) const
+		{
+			const size_t ovbracket = getOvbracket(overall);
+			const double * row = &table[rows[ovbracket]];
+			const size_t nthresholds = (rows[ovbracket+1] - rows[ovbracket])/2;
+			for(size_t i = 0; i < n; i++)
+			{
+				double raise = row[nthresholds + getSalaryBracket(row, nthresholds, salaries[i])];
+				out[i] = salaries[i] * (1.0 + raise/100.);
+			}
+		}
+
+		SalaryBrackets(istream & inputStream)
+		{
+			initialize(inputStream);
+		}
+
+		// Empty until initialized
+		SalaryBrackets()
+		{
+			;
+		}
+};
+
+class PlayerRater
+{
+	public:
+		double maxweight;
+		double minweight;
+
+		PlayerRater(double iMaxweight=0.5, double iMinweight=0.5) : maxweight(iMaxweight),minweight(iMinweight)
+		{
+			;
+		}
+
+		double getOFF(const PlayerTable & players, size_t player)
+		{
+			double off = (players.getRating(player, 1) + players.getRating(player, 2) + players.getRating(player, 3))/3.0;
+			return off;
+		}
+
+		double getDEF(const PlayerTable & players, size_t player)
+		{
+			double off = (players.getRating(player, 4) + players.getRating(player, 5) + players.getRating(player, 6))/3.0;
+			return off;
+		}
+
+		double getOverall(const PlayerTable & players, size_t player)
+		{
+			double off = getOFF(players, player);
+			double def = getDEF(players, player);
+
+			return (max(off,def)*maxweight + min(off,def)*minweight);
+		}
+};
+
+/*
+ * The salary model used without brackets. The only costly part, the base
+ * salary with its pow, depends on the overall alone, so a row of salaries
+ * at one overall works it out once; the results are exactly getSalary's.
+ */
+struct SalaryCurve
+{
+	double minov;
+	double midov;
+	double maxov;
+
+	double minsalary;
+	double maxsalary;
+
+	double qualratio;
+	double minlevel;
+
+	SalaryCurve() : minov(67), midov(75), maxov(87), minsalary(400000), maxsalary(8e6), qualratio(1.1), minlevel(0.7)
+	{
+		;
+	}
+
+	// -1 below minov, where every salary just gets the qualifying raise
+	double getBaseSalary(double overall) const
+	{
+		if(overall < minov) return -1;
+		if(overall > maxov) overall = maxov;
+		double exponent = 1.0;
+		if(overall >= midov)
+		{
+			exponent -= (overall-midov)/(maxov-midov);
+		}
+		else
+		{
+			exponent += (midov-overall)/(midov-minov);
+		}
+
+		return minsalary + pow((overall-minov)/(maxov-minov),exponent)*(maxsalary-minsalary);
+	}
+
+	double getSalaryFromBase(double currentSalary, double basesalary) const
+	{
+		if(basesalary < 0 || currentSalary >= basesalary) return currentSalary*qualratio;
+
+		double newsalary = minlevel*basesalary + (qualratio-minlevel)*basesalary*((currentSalary-minsalary)/(basesalary-minsalary));
+
+		return max(newsalary,max(minsalary,currentSalary)*qualratio);
+	}
+
+	void getSalaries(double overall, const double * salaries, double * out, size_t n) const
+	{
+		const double basesalary = getBaseSalary(overall);
+		for(size_t i = 0; i < n; i++) out[i] = getSalaryFromBase(salaries[i], basesalary);
+	}
+};
+
+double getSalary(double currentSalary,double overall)
+{
+	SalaryCurve curve;
+	return curve.getSalaryFromBase(currentSalary, curve.getBaseSalary(overall));
+}
+
+// salary is the bracket salary, before bonuses
+void outputBracketSalaryInfo(double salary, ofstream & outputStream, double statbonus=-1, double otherbonus=-1)
+{
+	if(statbonus >= 0)
+	{
+		salary += statbonus;
+	}
+	if(otherbonus >= 0)
+	{
+		salary += otherbonus;
+	}
+	outputStream << salary/1.e6;
+	if(statbonus >= 0)
+	{
+		outputStream << "\t" << statbonus/1.e6;
+	}
+	if(otherbonus >= 0)
+	{
+		outputStream << "\t" << otherbonus/1.e6;
+	}
+}
+
+void outputNewSalaryInfo(double currentSalary, double overall, ofstream & outputStream, double bonus=0)
+{
+	outputStream << (getSalary(currentSalary,overall)+bonus)/1e6;
+}
+
+void outputNewSalaryInfo(const PlayerTable & players, size_t player, double overall, ofstream & outputStream, double bracketSalary, double statBonus, double otherBonus = 0)
+{
+	double currentSalary = players.getSalary(player);
+	outputStream << players.getLastName(player) << ", " << players.getFirstName(player) << "\t" << overall << "\t" << currentSalary/1.e6 << "\t";
+	outputBracketSalaryInfo(bracketSalary,outputStream,statBonus,otherBonus);
+	outputStream << endl;
+}
+
+void outputNewSalaryInfo(const PlayerTable & players, size_t player, double overall, ofstream & outputStream)
+{
+	double currentSalary = players.getSalary(player);
+	outputStream << players.getLastName(player) << ", " << players.getFirstName(player) << "\t" << overall << "\t" << currentSalary/1.e6 << "\t";
+	outputNewSalaryInfo(currentSalary,overall,outputStream);
+	outputStream << endl;
+}
+
+// Weights of the better and the worse of OFF and DEF in a player's overall
+struct OverallWeights
+{
+	double maxWeight;
+	double minWeight;
+};
+
+/*
+ * The overall file's weight profiles: the first pair of weights is the one
+ * the RFA list is priced with, and any more pairs after it are extra
+ * profiles to compare it with.
+ */
+vector<OverallWeights> readOverallWeights(const string & overallFilename)
+{
+	vector<OverallWeights> profiles(1);
+	OverallWeights & weights = profiles[0];
+	weights.maxWeight = weights.minWeight = 0.5;
+
+	if(!overallFilename.empty())
+	{
+		ifstream overallFile(overallFilename.c_str());
+		overallFile >> weights.maxWeight;
+		overallFile >> weights.minWeight;
+		OverallWeights extra;
+		while(overallFile >> extra.maxWeight >> extra.minWeight) profiles.push_back(extra);
+		overallFile.close();
+	}
+	return profiles;
+}
+
+/*
+ * OFF, DEF and stat bonuses of every player, and their overall under each
+ * of several weight profiles, worked out a column at a time from the
+ * table's rating arrays in loops the compiler can vectorize. OFF, DEF and
+ * overalls are the same as PlayerRater's; the bonus is 250000 for each of
+ * ratings 7 to 12 and consistency above 80.
+ */
+struct PlayerRatings
+{
+	vector<double> off;
+	vector<double> def;
+	vector<double> bonuses;
+	// overalls[profile][player]
+	vector<vector<double> > overalls;
+};
+
+PlayerRatings ratePlayers(const PlayerTable & players, const vector<OverallWeights> & profiles)
+{
+	const size_t nplayers = players.size();
+	PlayerRatings rated;
+	rated.off.resize(nplayers);
+	rated.def.resize(nplayers);
+	rated.bonuses.resize(nplayers);
+	rated.overalls.assign(profiles.size(), vector<double>(nplayers));
+
+	const int * off[3] = {players.getRatings(1), players.getRatings(2), players.getRatings(3)};
+	const int * def[3] = {players.getRatings(4), players.getRatings(5), players.getRatings(6)};
+	for(size_t i = 0; i < nplayers; i++)
+	{
+		rated.off[i] = (off[0][i] + off[1][i] + off[2][i])/3.0;
+		rated.def[i] = (def[0][i] + def[1][i] + def[2][i])/3.0;
+	}
+
+	vector<int> bonusCounts(nplayers);
+	for(int rating = 7; rating < 13; rating++)
+	{
+		const int * values = players.getRatings(rating);
+		for(size_t i = 0; i < nplayers; i++) bonusCounts[i] += values[i] > 80;
+	}
+	const int * consistencies = players.getConsistencies();
+	for(size_t i = 0; i < nplayers; i++)
+	{
+		rated.bonuses[i] = 250000.0*(bonusCounts[i] + (consistencies[i] > 80));
+	}
+
+	for(size_t profile = 0; profile < profiles.size(); profile++)
+	{
+		const double maxWeight = profiles[profile].maxWeight;
+		const double minWeight = profiles[profile].minWeight;
+		double * overalls = rated.overalls[profile].data();
+		for(size_t i = 0; i < nplayers; i++)
+		{
+			overalls[i] = max(rated.off[i],rated.def[i])*maxWeight + min(rated.off[i],rated.def[i])*minWeight;
+		}
+	}
+	return rated;
+}
+
+/*
+ * Without brackets, new salaries come from getSalary. The RFA list uses the
+ * first weight profile; each further profile gets an RFA list of its own.
+ */
+void outputNewSalariesInfo(const PlayerTable & players, size_t nplayers, string outputFilename,
+	const vector<OverallWeights> & profiles, const SalaryBrackets * brackets)
+{
+	ofstream outputFile(outputFilename.c_str());
+
+	outputFile.precision(2);
+	outputFile.setf(ios::fixed);
+
+	outputFile << "OV\\SAL\t";
+	for(double currentSalary = 400000; currentSalary<9000000; currentSalary+=400000) outputFile << currentSalary/1.e6 << "\t";
+	outputFile << endl;
+
+	bool useBrackets = brackets != NULL;
+
+	// Bracket salaries are priced a whole row or list at a time
+	vector<double> salaries;
+	vector<double> overalls;
+	vector<double> newSalaries;
+
+	for(double overall = 65; overall <= 90; overall+=2)
+	{
+		outputFile << overall << "\t";
+		salaries.clear();
+		for(double currentSalary = 400000; currentSalary<9000000; currentSalary+=400000) salaries.push_back(currentSalary);
+		newSalaries.resize(salaries.size());
+		if(useBrackets)
+		{
+			brackets->getSalaries(overall, salaries.data(), newSalaries.data(), salaries.size());
+		}
+		else
+		{
+			SalaryCurve().getSalaries(overall, salaries.data(), newSalaries.data(), salaries.size());
+		}
+		for(size_t i = 0; i < salaries.size(); i++)
+		{
+			outputFile << newSalaries[i]/1.e6 << "\t";
+		}
+		outputFile << endl;
+	}
+
+	const PlayerRatings rated = ratePlayers(players, profiles);
+	vector<size_t> candidates;
+	for(size_t player = 0; player < nplayers; player++)
+	{
+		bool isRFA = players.getContractLength(player) == 1 && !players.isAtLeast(player, 31, 2012, 7, 1);
+		if(isRFA) candidates.push_back(player);
+	}
+
+	for(size_t profile = 0; profile < profiles.size(); profile++)
+	{
+		if(profile == 0)
+		{
+			outputFile << "RFA List:" << endl;
+		}
+		else
+		{
+			outputFile << "RFA List (weights " << profiles[profile].maxWeight << ", " <<
+				profiles[profile].minWeight << "):" << endl;
+		}
+
+		vector<size_t> rfas;
+		vector<double> bonuses;
+		salaries.clear();
+		overalls.clear();
+		for(size_t i = 0; i < candidates.size(); i++)
+		{
+			const size_t player = candidates[i];
+			double overall = rated.overalls[profile][player];
+			if(overall > 65)
+			{
+				double off = rated.off[player];
+				double def = rated.def[player];
+				rfas.push_back(player);
+				overalls.push_back(overall);
+				salaries.push_back(players.getSalary(player));
+				bonuses.push_back(500000*(off >= (def+5)) + 250000*(def >= (off+5)));
+			}
+		}
+
+		if(useBrackets)
+		{
+			newSalaries.resize(rfas.size());
+			brackets->getSalaries(salaries.data(), overalls.data(), newSalaries.data(), rfas.size());
+		}
+		for(size_t i = 0; i < rfas.size(); i++)
+		{
+			if(useBrackets)
+			{
+				outputNewSalaryInfo(players, rfas[i], overalls[i], outputFile, newSalaries[i],
+					rated.bonuses[rfas[i]], bonuses[i]);
+			}
+			else
+			{
+				outputNewSalaryInfo(players, rfas[i], overalls[i], outputFile);
+			}
+		}
+	}
+}
+
+const size_t NOMATCH = size_t(-1);
+
+/*
+ * Rows of one PlayerTable matched to rows of another by player identity
+ * (PlayerTable::hashKey) instead of by position, so inserted or reordered
+ * players still pair up. Keys that aren't unique on either side are
+ * ambiguous. Rows without a unique match (e.g. row 0 of a start of season
+ * file read with its count line) fall back to their positional partner,
+ * as the check did before, and are listed as unmatched or ambiguous.
+ */
+struct PlayerMatches
+{
+	// matched row of the other table for each row, or NOMATCH past its end
+	vector<size_t> rows;
+	vector<size_t> unmatched;
+	vector<size_t> ambiguous;
+};
+
+PlayerMatches matchPlayers(const PlayerTable & from, const PlayerTable & to)
+{
+	// open addressing with linear probing over a power of two at most half full
+	struct Slot
+	{
+		uint64_t hash;
+		size_t row;
+		bool duplicate;
+	};
+	size_t capacity = 16;
+	while(capacity < 2*to.size()) capacity *= 2;
+	const size_t mask = capacity - 1;
+	Slot empty = {0, NOMATCH, false};
+	vector<Slot> slots(capacity, empty);
+
+	for(size_t row = 0; row < to.size(); row++)
+	{
+		uint64_t hash = to.hashKey(row);
+		size_t slot = hash & mask;
+		while(slots[slot].row != NOMATCH &&
+			!(slots[slot].hash == hash && to.sameKey(slots[slot].row, to, row)))
+		{
+			slot = (slot + 1) & mask;
+		}
+		if(slots[slot].row == NOMATCH)
+		{
+			Slot filled = {hash, row, false};
+			slots[slot] = filled;
+		}
+		else
+		{
+			slots[slot].duplicate = true;
+		}
+	}
+
+	PlayerMatches matches;
+	matches.rows.assign(from.size(), NOMATCH);
+	vector<uint32_t> hits(to.size(), 0);
+	vector<bool> duplicate(from.size(), false);
+	for(size_t row = 0; row < from.size(); row++)
+	{
+		uint64_t hash = from.hashKey(row);
+		size_t slot = hash & mask;
+		while(slots[slot].row != NOMATCH &&
+			!(slots[slot].hash == hash && from.sameKey(row, to, slots[slot].row)))
+		{
+			slot = (slot + 1) & mask;
+		}
+		if(slots[slot].row != NOMATCH)
+		{
+			matches.rows[row] = slots[slot].row;
+			duplicate[row] = slots[slot].duplicate;
+			hits[slots[slot].row]++;
+		}
+	}
+
+	for(size_t row = 0; row < from.size(); row++)
+	{
+		size_t match = matches.rows[row];
+		if(match == NOMATCH) matches.unmatched.push_back(row);
+		else if(duplicate[row] || hits[match] > 1) matches.ambiguous.push_back(row);
+		else continue;
+		matches.rows[row] = row < to.size() ? row : NOMATCH;
+	}
+	return matches;
+}
+
+// Lists the start of season players the current file has no (unambiguous) match for
+void writePlayerMatches(const string & filename, const PlayerTable & playerCaps, const PlayerMatches & matches)
+{
+	ofstream matchFile(filename.c_str());
+	matchFile << "Unmatched: " << matches.unmatched.size() << " Ambiguous: " << matches.ambiguous.size() << endl;
+	for(size_t i = 0; i < matches.ambiguous.size(); i++)
+	{
+		size_t row = matches.ambiguous[i];
+		matchFile << "Ambiguous " << row << " " << playerCaps.getFirstName(row) << " " <<
+			playerCaps.getLastName(row) << (matches.rows[row] == NOMATCH ? "" : " (kept by position)") << endl;
+	}
+	for(size_t i = 0; i < matches.unmatched.size(); i++)
+	{
+		size_t row = matches.unmatched[i];
+		matchFile << "Unmatched " << row << " " << playerCaps.getFirstName(row) << " " <<
+			playerCaps.getLastName(row) << (matches.rows[row] == NOMATCH ? "" : " (kept by position)") << endl;
+	}
+}
+
+double getCapLine(istream & teamCapFile, int day, int month, int year, const PlayerTable & playerCaps, int npcs,
+	const PlayerTable & players, const PlayerMatches & matches, ostream & checkFile)
+{
+	if(!(teamCapFile.eof() || teamCapFile.peek() == EOF))
+	{
+		int iDay;
+		teamCapFile >> iDay;
+		if(iDay != day)
+		{
+			assert(iDay == day);
+		}
+		int iMonth;
+		teamCapFile >> iMonth;
+		assert(iMonth == month);
+		int iYear;
+		teamCapFile >> iYear;
+		assert(iYear == year);
+
+		caphit teamcap;
+		teamCapFile >> teamcap;
+
+		caphit penalties;
+		teamCapFile >> penalties;
+
+		caphit ltir;
+		teamCapFile >> ltir;
+
+		int nplayers;
+		teamCapFile >> nplayers;
+
+		for(int p = 0; p < nplayers; p++)
+		{
+			int id; teamCapFile >> id;
+			int team; teamCapFile >> team;
+			string firstName; teamCapFile >> firstName;
+			string lastName; teamCapFile >> lastName;
+			double salary; teamCapFile >> salary;
+
+			int oldsal = 0;
+			int currsal = 0;
+			if(id >= 0)
+			{
+				if(id < npcs) oldsal = playerCaps.getSalary(id);
+				if(id < npcs && matches.rows[id] != NOMATCH) currsal = players.getSalary(matches.rows[id]);
+			}
+
+			bool matchedSalary = (oldsal == salary || currsal == salary);
+			if(!matchedSalary)
+			{
+				checkFile << "Mismatch game " << iDay << "/" << iMonth <<
+					"/" << iYear << " playerid " << id << " salary " <<
+					salary	<< " old file " << oldsal << " current file " <<
+					currsal << endl;
+			}
+		}
+
+		string temp;
+		getline(teamCapFile,temp);
+
+		if(!temp.empty())
+		{
+			throw runtime_error("Error! Team cap file EOL is " + temp +
+				" instead of empty; aborting.");
+		}
+
+		return teamcap;
+	}
+	return 0;
+}
+
+double getAdjustedCap(double caphit, double penalties, double ltir, double maxcap)
+{
+	caphit = caphit + penalties;
+	if(caphit > maxcap)
+	{
+		caphit = max(maxcap,caphit-ltir);
+	}
+	return caphit;
+}
+
+bool isPro(size_t team)
+{
+	return team > 0 && team <= 2*NTEAMS;
+}
+
+bool isNHL(size_t team)
+{
+	return team > 0 && team <= NTEAMS;
+}
+
+bool isAHL(size_t team)
+{
+	return team > NTEAMS && team <= 2*NTEAMS;
+}
+
+// What getCapHit needs to know about a player besides salary, as bits
+enum PlayerLeague
+{
+	LEAGUENHL = 1,
+	LEAGUEAHL = 2,
+	LEAGUEPRO = LEAGUENHL | LEAGUEAHL,
+	// too young to need waivers on YEAR_FIRST's cutoff
+	WAIVEREXEMPT = 4
+};
+
+unsigned char getPlayerLeague(const PlayerTable & players, size_t player)
+{
+	const size_t team = players.getTeam(player);
+	return LEAGUENHL*isNHL(team) | LEAGUEAHL*isAHL(team) |
+		WAIVEREXEMPT*!players.isAtLeast(player, WAIVERAGE, YEAR_FIRST, 9, 15);
+}
+
+// AHL players only count when they'd need waivers, and then only above MAXAHLSALARY
+caphit getCapHit(caphit salary, unsigned char league)
+{
+	const bool ahl = (league & LEAGUEAHL) != 0;
+	return max(caphit(0), salary*((league & LEAGUENHL) || (ahl && !(league & WAIVEREXEMPT))) - MAXAHLSALARY*ahl);
+}
+
+/*
+ * Every player's cap hit and league, worked out once from the start of
+ * season file so that team totals are sums over arrays. Waivers go by age
+ * on YEAR_FIRST's cutoff, so none of it changes during the season.
+ */
+struct PlayerCapHits
+{
+	vector<caphit> capHits;
+	vector<unsigned char> leagues;
+
+	PlayerCapHits(const PlayerTable & players) : capHits(players.size()), leagues(players.size())
+	{
+		for(size_t row = 0; row < players.size(); row++)
+		{
+			leagues[row] = getPlayerLeague(players, row);
+			capHits[row] = getCapHit(players.getSalary(row), leagues[row]);
+		}
+	}
+};
+
+/*
+ * What the cap reports say about one team: its cap players with their cap
+ * hits, the totals they add up to, and once the history has been appended,
+ * its running cap and projections.
+ */
+struct TeamCap
+{
+	// in row order, with playerCapHits alongside
+	vector<size_t> players;
+	vector<caphit> playerCapHits;
+	// sum of playerCapHits, then with the minimum roster filled (no penalties)
+	caphit roster;
+	caphit capHit;
+	size_t contracts;
+
+	caphit penalties;
+	caphit ltir;
+
+	int gamesPlayed;
+	double today;
+	double todate;
+	double projected;
+	double maxcap;
+	double capspace;
+};
+
+TeamCap getTeamCap(const PlayerCapHits & capHits, const vector<size_t> & capPlayers)
+{
+	TeamCap cap = TeamCap();
+	cap.players = capPlayers;
+	cap.playerCapHits.resize(capPlayers.size());
+	size_t npro = 0;
+	for(size_t i = 0; i < capPlayers.size(); i++)
+	{
+		const size_t row = capPlayers[i];
+		const unsigned char league = capHits.leagues[row];
+		cap.playerCapHits[i] = capHits.capHits[row];
+		cap.roster += cap.playerCapHits[i];
+		cap.contracts += (league & LEAGUEPRO) != 0;
+		npro += league & LEAGUENHL;
+	}
+	cap.capHit = cap.roster;
+	if(npro < MINNPRO) cap.capHit += (MINNPRO - npro)*MINCAPHITCURR;
+	return cap;
+}
+
+/*
+ * Every team's TeamCap on one date, worked out once a run. caps.txt,
+ * caphits.txt, the cap history lines and the --cap-model files are all
+ * written from it.
+ */
+struct CapModel
+{
+	int year;
+	int month;
+	int day;
+	TeamCap teams[NTEAMS];
+
+	CapModel() : year(0), month(0), day(0)
+	{
+		;
+	}
+
+	void setAmounts(const caphit penalties[NTEAMS], const caphit ltir[NTEAMS])
+	{
+		for(size_t team = 0; team < NTEAMS; team++)
+		{
+			teams[team].penalties = penalties[team];
+			teams[team].ltir = ltir[team];
+		}
+	}
+
+	// Projects the rest of the season from the team's average cap over its games so far
+	void project(size_t team, int gamesPlayed, double todate)
+	{
+		TeamCap & cap = teams[team];
+		cap.gamesPlayed = gamesPlayed;
+		cap.today = getAdjustedCap(cap.capHit, cap.penalties, cap.ltir, MAXCAP);
+		cap.todate = gamesPlayed > 0 ? todate/gamesPlayed : todate;
+		cap.projected = (cap.todate*gamesPlayed + cap.today*double(NGAMES - gamesPlayed))/double(NGAMES);
+		cap.maxcap = (MAXCAP*NGAMES - cap.todate*gamesPlayed)/double(NGAMES - gamesPlayed);
+		cap.capspace = cap.maxcap - cap.today;
+	}
+};
+
+// Appends the cap lines of the given team's entries to its cap file
+void writeCapLines(const vector<int> & gameDays, const vector<int> & gameMonths, const vector<int> & gameYears,
+		const vector<int> & capTeams, int team, const TeamCap & cap, ostream & ofile, const PlayerTable & players)
+{
+	unsigned int entries = capTeams.size();
+	assert(entries == gameDays.size());
+	assert(entries == gameMonths.size());
+	assert(entries == gameYears.size());
+	for(unsigned int entry = 0; entry < entries; entry++)
+	{
+		if(capTeams.at(entry) != team) continue;
+		ofile << gameDays.at(entry) << " ";
+		ofile << gameMonths.at(entry) << " ";
+		ofile << gameYears.at(entry) << " ";
+		ofile << cap.capHit << " ";
+		ofile << cap.penalties << " ";
+		ofile << cap.ltir << " ";
+		ofile << cap.players.size();
+
+		for(size_t i = 0; i < cap.players.size(); i++)
+		{
+			const size_t player = cap.players[i];
+			ofile << " " << player  << " " << players.getTeam(player) << " " <<
+				players.getFirstName(player) << " ";
+			// spaces in last names are replaced so the line splits on spaces
+			TextView lastname = players.getLastName(player);
+			const char * end = lastname.data + lastname.size;
+			for(const char * part = lastname.data; ; )
+			{
+				const char * space = static_cast<const char *>(memchr(part, ' ', end - part));
+				ofile.write(part, (space == NULL ? end : space) - part);
+				if(space == NULL) break;
+				ofile << SPACEREPLACE;
+				part = space + 1;
+			}
+			ofile << " " << cap.playerCapHits[i];
+		}
+
+		ofile << endl;
+	}
+}
+
+// The team's section of caps.txt, players by descending salary
+string capsText(const TeamCap & cap, size_t team, const PlayerTable & players)
+{
+	vector<size_t> order(cap.players.size());
+	iota(order.begin(), order.end(), 0);
+	const HigherSalary higher(players);
+	sort(order.begin(), order.end(), [&](size_t i, size_t j)
+	{
+		return higher(cap.players[i], cap.players[j]);
+	});
+
+	ostringstream capOut;
+	capOut << TEAMNAMES[team] << endl;
+	for(size_t i = 0; i < order.size(); i++)
+	{
+		const size_t player = cap.players[order[i]];
+		capOut << players.getLastName(player) << ", " << players.getFirstName(player) << "\t" <<
+			cap.playerCapHits[order[i]] << endl;
+	}
+	capOut << "Roster: " << cap.roster << endl;
+	capOut << "Penalties: " << cap.penalties << endl;
+	capOut << "Total: " << cap.roster+cap.penalties <<
+		" vs. final " << cap.capHit+cap.penalties << endl;
+	capOut << "Contracts: " << cap.contracts << endl << endl;
+	return capOut.str();
+}
+
+// The team's row of caphits.txt
+string capHitsRow(const TeamCap & cap, size_t team)
+{
+	char buf[1000];
+	sprintf(buf, "%-6s%-6i%-6i%-10i%-10i%-10i%-10i%-10i  %-6s %-6i %-10i %-i",
+		TEAMNAMES[team].c_str(),team+1, cap.gamesPlayed,
+		int(cap.today), int(cap.todate), cap.penalties, cap.ltir,
+		int(cap.projected), cap.projected > MAXCAP ? "Y" : "N", cap.contracts, int(cap.maxcap), int(cap.capspace));
+	return buf;
+}
+
+// caphits.txt as CSV, a row per team
+void writeCapModelCSV(const CapModel & model, ostream & out)
+{
+	out << "team,team_id,games_played,today,to_date,penalties,ltir,projected,over_cap,contracts,max_cap,cap_space,"
+		"roster,cap_hit" << "\n";
+	for(size_t team = 0; team < NTEAMS; team++)
+	{
+		const TeamCap & cap = model.teams[team];
+		out << TEAMNAMES[team] << "," << team+1 << "," << cap.gamesPlayed << "," << int(cap.today) << "," <<
+			int(cap.todate) << "," << cap.penalties << "," << cap.ltir << "," << int(cap.projected) << "," <<
+			(cap.projected > MAXCAP ? "Y" : "N") << "," << cap.contracts << "," << int(cap.maxcap) << "," <<
+			int(cap.capspace) << "," << cap.roster << "," << cap.capHit << "\n";
+	}
+}
+
+void writeJSONString(ostream & out, const TextView & text)
+{
+	out << '"';
+	for(size_t i = 0; i < text.size; i++)
+	{
+		const unsigned char c = text.data[i];
+		if(c == '"' || c == '\\') out << '\\' << c;
+		else if(c < 0x20)
+		{
+			char escaped[8];
+			sprintf(escaped, "\\u%04x", c);
+			out << escaped;
+		}
+		else out << c;
+	}
+	out << '"';
+}
+
+// The caphits.txt columns of every team and the cap hit of each of its players
+void writeCapModelJSON(const CapModel & model, const PlayerTable & players, ostream & out)
+{
+	out << "{\n  \"year\": " << model.year << ", \"month\": " << model.month << ", \"day\": " << model.day <<
+		",\n  \"teams\": [";
+	for(size_t team = 0; team < NTEAMS; team++)
+	{
+		const TeamCap & cap = model.teams[team];
+		out << (team ? "," : "") << "\n    {\"team\": \"" << TEAMNAMES[team] << "\", \"team_id\": " << team+1 <<
+			", \"games_played\": " << cap.gamesPlayed << ", \"today\": " << int(cap.today) <<
+			", \"to_date\": " << int(cap.todate) << ", \"penalties\": " << cap.penalties <<
+			", \"ltir\": " << cap.ltir << ", \"projected\": " << int(cap.projected) <<
+			", \"over_cap\": " << (cap.projected > MAXCAP ? "true" : "false") << ", \"contracts\": " << cap.contracts <<
+			", \"max_cap\": " << int(cap.maxcap) << ", \"cap_space\": " << int(cap.capspace) <<
+			", \"roster\": " << cap.roster << ", \"cap_hit\": " << cap.capHit << ",\n     \"players\": [";
+		for(size_t i = 0; i < cap.players.size(); i++)
+		{
+			const size_t player = cap.players[i];
+			out << (i ? "," : "") << "\n      {\"id\": " << player << ", \"team\": " << players.getTeam(player) <<
+				", \"first_name\": ";
+			writeJSONString(out, players.getFirstName(player));
+			out << ", \"last_name\": ";
+			writeJSONString(out, players.getLastName(player));
+			out << ", \"salary\": " << players.getSalary(player) << ", \"cap_hit\": " << cap.playerCapHits[i] << "}";
+		}
+		out << "]}";
+	}
+	out << "\n  ]\n}" << endl;
+}
+
+/*
+ * A team cap file as read into memory: all its bytes, as on disk, and the
+ * text of its running cap index. Missing files are empty.
+ */
+struct TeamFile
+{
+	string filename;
+	bool exists;
+	string bytes;
+	string indexText;
+
+	TeamFile() : exists(false)
+	{
+		;
+	}
+};
+
+// Reads all of a file, false if it can't be opened
+bool readBytes(const string & filename, string & bytes, uint64_t from = 0)
+{
+	ifstream file(filename.c_str(), ios::binary);
+	if(!file.is_open()) return false;
+	file.seekg(0, ios::end);
+	const uint64_t size = file.tellg();
+	bytes.resize(from < size ? size - from : 0);
+	file.seekg(from);
+	if(!bytes.empty()) file.read(&bytes[0], bytes.size());
+	return true;
+}
+
+void readTeamFile(TeamFile & file)
+{
+	file.exists = readBytes(file.filename, file.bytes);
+	if(!file.exists) file.bytes.clear();
+	if(!readBytes(file.filename + ".idx", file.indexText)) file.indexText.clear();
+}
+
+/*
+ * Appends lines to the team cap file, then reads back what was written so
+ * the bytes in memory match the file's, whatever text mode made of the line
+ * ends. False if the file couldn't be written.
+ */
+bool appendTeamFile(TeamFile & file, const string & lines)
+{
+	ofstream teamOFile(file.filename.c_str(), std::ofstream::app);
+	if(!teamOFile.is_open()) return false;
+	teamOFile << lines;
+	teamOFile.close();
+	if(!teamOFile) return false;
+	file.exists = true;
+	if(lines.empty()) return true;
+
+	string written;
+	if(readBytes(file.filename, written, file.bytes.size())) file.bytes += written;
+	return true;
+}
+
+// CRLF line ends as LF, as reading in text mode gives them
+string textMode(const string & bytes)
+{
+	if(bytes.find('\r') == string::npos) return bytes;
+	string text;
+	text.reserve(bytes.size());
+	for(size_t i = 0; i < bytes.size(); i++)
+	{
+		if(!(bytes[i] == '\r' && i + 1 < bytes.size() && bytes[i+1] == '\n')) text += bytes[i];
+	}
+	return text;
+}
+
+// Team file I/O is mostly waiting, so it gets this many threads whatever --threads is
+const unsigned int NIOTHREADS = 8;
+
+/*
+ * The team cap files of a cap directory (with their running cap indexes),
+ * read as one batch on NIOTHREADS threads. The reads start as soon as it's
+ * made and run alongside whatever the caller does before wait, e.g. reading
+ * the schedule. Cap files are only ever appended to, so after that the
+ * checks and running caps work from the bytes read here, which
+ * appendTeamFile keeps in step with the files.
+ */
+class TeamFiles
+{
+	private:
+		TeamFile files[NTEAMS];
+		exception_ptr error;
+		thread reader;
+
+		TeamFiles(const TeamFiles &) = delete;
+		TeamFiles & operator=(const TeamFiles &) = delete;
+
+	public:
+		TeamFiles(const string & capdirectory)
+		{
+			for(size_t team = 0; team < NTEAMS; team++) files[team].filename = capdirectory + "/" + TEAMNAMES[team] + ".txt";
+			reader = thread([this]()
+			{
+				try
+				{
+					runTasks(NTEAMS, NIOTHREADS, [this](size_t team)
+					{
+						readTeamFile(files[team]);
+					});
+				}
+				catch(...)
+				{
+					error = current_exception();
+				}
+			});
+		}
+
+		~TeamFiles()
+		{
+			if(reader.joinable()) reader.join();
+		}
+
+		// Waits for the reads to finish, rethrowing the first that failed
+		void wait()
+		{
+			if(reader.joinable()) reader.join();
+			if(error) rethrow_exception(error);
+		}
+
+		TeamFile & operator[](size_t team)
+		{
+			return files[team];
+		}
+
+		const TeamFile & operator[](size_t team) const
+		{
+			return files[team];
+		}
+};
+
+/*
+ * The lines one run appends to the team cap files, with each file's size
+ * before them. Teams without lines have nothing to append.
+ */
+struct CapJournal
+{
+	uint64_t sizes[NTEAMS];
+	string lines[NTEAMS];
+
+	CapJournal()
+	{
+		fill(sizes, sizes + NTEAMS, 0);
+	}
+};
+
+/*
+ * Cap history appends are committed through this file in the cap directory,
+ * so a run that dies partway through leaves every team file either with all
+ * of its new lines or none. The whole journal is written (under a temporary
+ * name, synced once, then renamed into place) before any team file is
+ * touched. It's deleted once every team file has its lines and the files
+ * have been synced, as one batch after all the appends. A journal found on
+ * startup was left by a run that died while appending (or before its team
+ * files reached the disk), and is replayed: each team file is cut back to
+ * its size before that run and gets its lines again. One that's incomplete,
+ * or whose team files are now shorter than it says they were, is discarded.
+ */
+const string CAPJOURNAL = "cap_history.journal";
+const string CAPJOURNALMAGIC = "EHMCAPJOURNAL";
+
+bool writeCapJournal(const string & filename, const CapJournal & journal)
+{
+	ostringstream record;
+	record << CAPJOURNALMAGIC << "\n";
+	for(size_t team = 0; team < NTEAMS; team++)
+	{
+		if(journal.lines[team].empty()) continue;
+		record << team << " " << journal.sizes[team] << " " << journal.lines[team].size() << "\n" << journal.lines[team];
+	}
+	record << "end\n";
+	const string bytes = record.str();
+
+	string tempname = filename + ".tmp";
+	HANDLE file = CreateFileA(tempname.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(file == INVALID_HANDLE_VALUE) return false;
+	DWORD written = 0;
+	bool complete = WriteFile(file, bytes.data(), bytes.size(), &written, NULL) && written == bytes.size() &&
+		FlushFileBuffers(file);
+	CloseHandle(file);
+	if(!complete)
+	{
+		DeleteFileA(tempname.c_str());
+		return false;
+	}
+	return MoveFileExA(tempname.c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING);
+}
+
+// False if the journal is missing or incomplete
+bool readCapJournal(const string & filename, CapJournal & journal)
+{
+	string bytes;
+	if(!readBytes(filename, bytes)) return false;
+	istringstream record(bytes);
+	string word;
+	if(!(record >> word) || word != CAPJOURNALMAGIC) return false;
+	while(record >> word && word != "end")
+	{
+		size_t team = NTEAMS;
+		uint64_t length = 0;
+		istringstream(word) >> team;
+		if(team >= NTEAMS || !(record >> journal.sizes[team] >> length) || record.get() != '\n' ||
+			length > bytes.size())
+		{
+			return false;
+		}
+		journal.lines[team].resize(length);
+		if(length > 0 && !record.read(&journal.lines[team][0], length)) return false;
+	}
+	return word == "end";
+}
+
+// Cuts a file back to size bytes (creating it if it's missing), false if it can't be
+bool truncateFile(const string & filename, uint64_t size)
+{
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(file == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER position;
+	position.QuadPart = size;
+	bool done = SetFilePointerEx(file, position, NULL, FILE_BEGIN) && SetEndOfFile(file);
+	CloseHandle(file);
+	return done;
+}
+
+// Writes a file's cached data to disk, false if it can't be
+bool syncFile(const string & filename)
+{
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	if(file == INVALID_HANDLE_VALUE) return false;
+	bool synced = FlushFileBuffers(file);
+	CloseHandle(file);
+	return synced;
+}
+
+// Syncs the team files with lines in the journal, as one batch, so it can be deleted
+void syncCapHistory(const string teamFilenames[NTEAMS], const CapJournal & journal)
+{
+	runTasks(NTEAMS, NIOTHREADS, [&](size_t team)
+	{
+		if(!journal.lines[team].empty() && !syncFile(teamFilenames[team]))
+		{
+			throw runtime_error("Error! Couldn't sync " + teamFilenames[team] + "; aborting.");
+		}
+	});
+}
+
+// Replays or discards the journal a run that died while appending left behind
+void recoverCapHistory(const string & capdirectory)
+{
+	const string filename = capdirectory + "/" + CAPJOURNAL;
+	if(GetFileAttributesA(filename.c_str()) == INVALID_FILE_ATTRIBUTES) return;
+
+	CapJournal journal;
+	bool replay = readCapJournal(filename, journal);
+	string teamFilenames[NTEAMS];
+	for(size_t team = 0; team < NTEAMS; team++)
+	{
+		teamFilenames[team] = capdirectory + "/" + TEAMNAMES[team] + ".txt";
+		if(!journal.lines[team].empty() && getFileSize(teamFilenames[team]) < journal.sizes[team]) replay = false;
+	}
+
+	if(replay)
+	{
+		// the journal stays until every team file has its lines back
+		runTasks(NTEAMS, NIOTHREADS, [&](size_t team)
+		{
+			if(journal.lines[team].empty()) return;
+			TeamFile file;
+			file.filename = teamFilenames[team];
+			if(!truncateFile(file.filename, journal.sizes[team]) || !appendTeamFile(file, journal.lines[team]))
+			{
+				throw runtime_error("Error! Couldn't replay " + filename + " into " + file.filename + "; aborting.");
+			}
+		});
+		syncCapHistory(teamFilenames, journal);
+		cout << "Replayed the cap history appends of an unfinished run from " << filename << endl;
+	}
+	else
+	{
+		cerr << "Discarded the incomplete cap history journal " << filename << endl;
+	}
+	DeleteFileA(filename.c_str());
+}
+
+// Appends every team's lines to its file through the journal
+void commitCapHistory(const string & capdirectory, TeamFiles & teamFiles, const CapJournal & journal,
+	RunStats * stats = NULL)
+{
+	const string filename = capdirectory + "/" + CAPJOURNAL;
+	if(!writeCapJournal(filename, journal))
+	{
+		throw runtime_error("Error! Couldn't write " + filename + "; aborting.");
+	}
+	runTasks(NTEAMS, NIOTHREADS, [&](size_t team)
+	{
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		if(!appendTeamFile(teamFiles[team], journal.lines[team]))
+		{
+			throw runtime_error("Error! Couldn't append to " + teamFiles[team].filename + "; aborting.");
+		}
+		if(stats != NULL)
+		{
+			stats->addTeamTime("history_append", team, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+		}
+	});
+
+	// the journal only goes once the lines it holds are on disk in the team files
+	string teamFilenames[NTEAMS];
+	for(size_t team = 0; team < NTEAMS; team++) teamFilenames[team] = teamFiles[team].filename;
+	syncCapHistory(teamFilenames, journal);
+	DeleteFileA(filename.c_str());
+}
+
+/*
+ * What getRunningCap has already summed from a team cap file, kept next to
+ * it in <TEAM>.txt.idx. Cap files are only ever appended to, so the next run
+ * carries on from offset. Everything summed so far is hashed, so a file that
+ * was rewritten, truncated or edited anywhere before offset (even keeping its
+ * length) is caught and rescanned from the top, giving what a full rescan
+ * would.
+ */
+struct RunningCapIndex
+{
+	uint64_t offset;
+	uint64_t prefixHash;
+	int games;
+	double totalcap;
+
+	RunningCapIndex() : offset(0), prefixHash(0), games(0), totalcap(0)
+	{
+		;
+	}
+
+	// Parses the index file's text, false if it isn't an index
+	bool read(const string & text)
+	{
+		istringstream file(text);
+		// totalcap is stored bit for bit so the sum carries on exactly
+		uint64_t totalbits = 0;
+		file >> offset >> prefixHash >> games >> totalbits;
+		memcpy(&totalcap, &totalbits, sizeof(totalcap));
+		return !file.fail();
+	}
+
+	void write(const string & filename) const
+	{
+		uint64_t totalbits;
+		memcpy(&totalbits, &totalcap, sizeof(totalbits));
+		ofstream file(filename.c_str());
+		file << offset << " " << prefixHash << " " << games << " " << totalbits << endl;
+	}
+
+	bool matches(const string & bytes) const
+	{
+		return offset <= bytes.size() && (offset == 0 || hashBytes(bytes.data(), offset) == prefixHash);
+	}
+};
+
+// scanned, if given, is set to the bytes of the file summed past the index
+double getRunningCap(int gamesPlayed, const TeamFile & file, uint64_t * scanned = NULL)
+{
+	if(scanned != NULL) *scanned = 0;
+	const string indexFilename = file.filename + ".idx";
+	RunningCapIndex index;
+	if(!(file.exists && index.read(file.indexText) && index.matches(file.bytes)))
+	{
+		index = RunningCapIndex();
+	}
+
+	double totalcap = index.totalcap;
+	int gamesCounted = index.games;
+	if(file.exists)
+	{
+		istringstream teamCapFile(file.bytes.substr(index.offset));
+		const uint64_t from = index.offset;
+		bool keepReading = teamCapFile.peek() != EOF;
+		bool newLines = keepReading;
+		while(keepReading)
+		{
+			int iDay;
+			teamCapFile >> iDay;
+			int iMonth;
+			teamCapFile >> iMonth;
+			int iYear;
+			teamCapFile >> iYear;
+
+			double caphit;
+			teamCapFile >> caphit;
+			assert(caphit > 0);
+
+			double penalties;
+			teamCapFile >> penalties;
+
+			double ltir;
+			teamCapFile >> ltir;
+
+			caphit = getAdjustedCap(caphit, penalties, ltir, MAXCAP);
+
+			totalcap += caphit;
+
+			string restLine;
+			getline(teamCapFile,restLine);
+
+			gamesCounted++;
+
+			keepReading = teamCapFile.peek() != EOF;
+		}
+
+		if(newLines)
+		{
+			index.offset = file.bytes.size();
+			index.prefixHash = hashBytes(file.bytes.data(), index.offset);
+			index.games = gamesCounted;
+			index.totalcap = totalcap;
+			index.write(indexFilename);
+			if(scanned != NULL) *scanned = index.offset - from;
+		}
+	}
+	if(gamesCounted != gamesPlayed)
+	{
+		throw runtime_error("Error! Games counted " + to_string(gamesCounted) +
+			" doesn't match " + to_string(gamesPlayed) + "games played in file " +
+			file.filename + "; aborting.");
+	}
+	return totalcap;
+}
+
+double getRunningCap(int gamesPlayed, const string & teamFilename, uint64_t * scanned = NULL)
+{
+	TeamFile file;
+	file.filename = teamFilename;
+	readTeamFile(file);
+	return getRunningCap(gamesPlayed, file, scanned);
+}
+
+struct ScheduledGame
+{
+	int day;
+	int month;
+	int year;
+	// zero-based, as read from the schedule minus one
+	size_t homeTeam;
+	size_t awayTeam;
+	int status;
+};
+
+/*
+ * All of schedule.ehm in one array, in file order, with the indexes of each
+ * team's games. EHM writes the schedule in date order, so the games played
+ * by a given date are a prefix of the array found by binary search, and a
+ * team's share of them is a binary search of its index. A schedule that isn't
+ * in date order falls back to the linear scan the file used to get.
+ */
+class Schedule
+{
+	private:
+		vector<ScheduledGame> games;
+		vector<uint32_t> teamGames[NTEAMS];
+		bool ordered;
+
+		struct Played
+		{
+			int year;
+			int month;
+			int day;
+
+			bool operator()(const ScheduledGame & game) const
+			{
+				return isPlayed(game, year, month, day);
+			}
+		};
+
+	public:
+		Schedule(const string & filename) : ordered(true)
+		{
+			MappedFile scheduleFile(filename);
+			EHMTokenizer tokens(scheduleFile.begin(), scheduleFile.end());
+			while(tokens.moreTokens())
+			{
+				ScheduledGame game;
+				game.day = tokens.readInt<int>();
+				game.month = tokens.readInt<int>();
+				game.year = tokens.readInt<int>();
+				game.homeTeam = tokens.readInt<size_t>() - 1;
+				game.awayTeam = tokens.readInt<size_t>() - 1;
+				game.status = tokens.readInt<int>();
+				tokens.skipLine();
+				// don't care about the score
+				tokens.skipLine();
+
+				if(!games.empty())
+				{
+					const ScheduledGame & last = games.back();
+					ordered = ordered && (game.year > last.year || (game.year == last.year &&
+						(game.month > last.month || (game.month == last.month && game.day >= last.day))));
+				}
+				ordered = ordered && game.month > 0;
+
+				if(game.homeTeam < NTEAMS) teamGames[game.homeTeam].push_back(games.size());
+				if(game.awayTeam < NTEAMS) teamGames[game.awayTeam].push_back(games.size());
+				games.push_back(game);
+			}
+		}
+
+		static bool isPlayed(const ScheduledGame & game, int currYear, int currMonth, int currDay)
+		{
+			bool played = game.year < currYear;
+			if(game.year == currYear)
+			{
+				played = (game.month < currMonth) && (game.month > 0);
+				if(game.month == currMonth)
+				{
+					played = game.day <= currDay;
+				}
+			}
+			return played;
+		}
+
+		size_t size() const
+		{
+			return games.size();
+		}
+
+		const ScheduledGame & operator[](size_t game) const
+		{
+			return games[game];
+		}
+
+		// Games up to the first one not played by the given date
+		size_t countPlayed(int year, int month, int day) const
+		{
+			Played played = {year, month, day};
+			if(ordered) return partition_point(games.begin(), games.end(), played) - games.begin();
+			return find_if_not(games.begin(), games.end(), played) - games.begin();
+		}
+
+		// Schedule index of the team's nth game
+		size_t teamGame(size_t team, size_t n) const
+		{
+			return teamGames[team][n];
+		}
+
+		// How many of the first ngames the team plays in
+		size_t countTeamGames(size_t team, size_t ngames) const
+		{
+			return lower_bound(teamGames[team].begin(), teamGames[team].end(), ngames) - teamGames[team].begin();
+		}
+};
+
+/*
+ * The result of reading a team cap file's lines for the team's played games,
+ * one line per game in schedule order, as getCapLine would in the schedule
+ * pass. The file stops being read at the first line that fails to parse.
+ */
+struct TeamCapCheck
+{
+	struct Mismatches
+	{
+		size_t line;
+		string text;
+	};
+
+	// cap hit of each line read, zero once the file runs out
+	vector<caphit> lineCaps;
+	vector<Mismatches> mismatches;
+	// line that failed to parse and why, if any did
+	size_t failedLine;
+	string error;
+	double seconds;
+
+	TeamCapCheck() : failedLine(NOMATCH), seconds(0)
+	{
+		;
+	}
+};
+
+void checkTeamCaps(const TeamFile & file, size_t team, const Schedule & schedule, size_t ngamesPlayed,
+	const PlayerTable & playerCaps, int npcs, const PlayerTable & players, const PlayerMatches & matches,
+	TeamCapCheck & check)
+{
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	istringstream teamFile(textMode(file.bytes));
+	const size_t ngames = schedule.countTeamGames(team, ngamesPlayed);
+	for(size_t line = 0; line < ngames; line++)
+	{
+		const ScheduledGame & game = schedule[schedule.teamGame(team, line)];
+		ostringstream lineCheck;
+		lineCheck.setf(ios::fixed);
+		lineCheck.precision(0);
+		try
+		{
+			check.lineCaps.push_back(getCapLine(teamFile, game.day, game.month, game.year,
+				playerCaps, npcs, players, matches, lineCheck));
+		}
+		catch(const exception & e)
+		{
+			check.failedLine = line;
+			check.error = e.what();
+			break;
+		}
+		if(lineCheck.tellp() > 0)
+		{
+			TeamCapCheck::Mismatches lineMismatches = {line, lineCheck.str()};
+			check.mismatches.push_back(lineMismatches);
+		}
+	}
+	check.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+/*
+ * Checks the played games in every team cap file against the player files,
+ * one team per task, then goes through the schedule in order as the serial
+ * pass did: mismatches go to check_caps.txt in game order (home team first),
+ * errors are thrown for the first game they'd have been hit at, and the
+ * games not yet logged are returned. Time taken per team is written to
+ * check_times.txt (and stats, if kept).
+ */
+void verifyCapHistory(const string & capdirectory, const TeamFiles & teamFiles, const Schedule & schedule,
+	size_t ngamesPlayed, const PlayerTable & playerCaps, int npcs, const PlayerTable & players,
+	const PlayerMatches & matches, unsigned int nthreads, vector<size_t> & unloggedGames, vector<int> & capTeams,
+	RunStats * stats = NULL)
+{
+	PhaseTimer timer(stats, "cap_verification");
+	vector<TeamCapCheck> checks(NTEAMS);
+	runTasks(NTEAMS, nthreads, [&](size_t team)
+	{
+		checkTeamCaps(teamFiles[team], team, schedule, ngamesPlayed, playerCaps, npcs, players,
+			matches, checks[team]);
+	});
+	for(size_t team = 0; team < NTEAMS && stats != NULL; team++)
+	{
+		stats->addTeamTime("cap_verification", team, checks[team].seconds);
+		timer.records += checks[team].lineCaps.size();
+		timer.bytesRead += teamFiles[team].bytes.size();
+	}
+
+	ofstream timesFile((capdirectory + "/check_times.txt").c_str());
+	timesFile << "TEAM  LINES  MISMATCHES  MS" << endl;
+	for(size_t team = 0; team < NTEAMS; team++)
+	{
+		timesFile << TEAMNAMES[team] << " " << checks[team].lineCaps.size() << " " <<
+			checks[team].mismatches.size() << " " << checks[team].seconds*1000 << endl;
+	}
+	timesFile.close();
+
+	ofstream checkFile((capdirectory + "/check_caps.txt").c_str());
+	size_t nextLine[NTEAMS] = {0};
+	size_t nextMismatch[NTEAMS] = {0};
+	for(size_t game = 0; game < ngamesPlayed; game++)
+	{
+		const size_t teams[2] = {schedule[game].homeTeam, schedule[game].awayTeam};
+		assert(teams[0] < NTEAMS);
+		assert(teams[1] < NTEAMS);
+		bool logged[2];
+		for(size_t side = 0; side < 2; side++)
+		{
+			const size_t team = teams[side];
+			const TeamCapCheck & check = checks[team];
+			const size_t line = nextLine[team]++;
+			if(line == check.failedLine) throw runtime_error(check.error);
+			while(nextMismatch[team] < check.mismatches.size() && check.mismatches[nextMismatch[team]].line == line)
+			{
+				checkFile << check.mismatches[nextMismatch[team]++].text;
+			}
+			assert(check.lineCaps[line] >= 0);
+			logged[side] = check.lineCaps[line] > 0;
+		}
+
+		if(logged[0] != logged[1])
+		{
+			throw std::runtime_error("Error! Home and away games not both logged; aborting.");
+		}
+
+		for(size_t side = 0; side < 2; side++)
+		{
+			if(!logged[side])
+			{
+				unloggedGames.push_back(game);
+				capTeams.push_back(teams[side]);
+			}
+		}
+	}
+}
+
+/*
+ * Per-team results that only change with the start of season file and
+ * penalties: cap hits go by YEAR_FIRST's waiver cutoff, not the save's
+ * date. Watch mode keeps them between recomputes, so each sim day only
+ * redoes the running caps and projections.
+ */
+struct ReportCache
+{
+	shared_ptr<const PlayerTable> playerCaps;
+	shared_ptr<const void> penalties;
+
+	// the cap players' cap hits and the team totals in model
+	bool haveModel;
+	CapModel model;
+
+	// caps.txt sections
+	bool haveCaps;
+	string capsTexts[NTEAMS];
+
+	ReportCache() : haveModel(false), haveCaps(false)
+	{
+		;
+	}
+
+	// Empties the cache unless it was filled from the same inputs
+	void use(const shared_ptr<const PlayerTable> & iPlayerCaps, const shared_ptr<const void> & iPenalties)
+	{
+		if(playerCaps != iPlayerCaps || penalties != iPenalties)
+		{
+			playerCaps = iPlayerCaps;
+			penalties = iPenalties;
+			haveModel = false;
+			haveCaps = false;
+		}
+	}
+};
+
+/*
+ * Appends the games played since the last run to the team cap files, checks
+ * the history already in them, and fills in model's running caps and
+ * projections for caphits.txt.
+ */
+void calcSalariesFromSchedule(const string & savedir, const string & capdirectory, CapModel & model,
+	const PlayerTable & playerCaps, int npcs, const PlayerTable & players, const PlayerMatches & matches,
+	unsigned int nthreads, RunStats * stats = NULL)
+{
+	recoverCapHistory(capdirectory);
+
+	// the team cap files are read while the schedule is
+	TeamFiles teamFiles(capdirectory);
+
+	PhaseTimer scheduleTimer(stats, "schedule_scan");
+	Schedule schedule(savedir + "/schedule.ehm");
+
+	vector<int> gameMonths;
+	vector<int> gameDays;
+	vector<int> gameYears;
+	vector<int> capTeams;
+
+	int gamesPlayed[NTEAMS];
+	for(size_t i = 0; i < NTEAMS; i++)
+	{
+		gamesPlayed[i] = 0;
+	}
+
+	const size_t ngamesPlayed = schedule.countPlayed(model.year, model.month, model.day);
+	for(size_t team = 0; team < NTEAMS; team++)
+	{
+		gamesPlayed[team] = schedule.countTeamGames(team, ngamesPlayed);
+	}
+	if(stats != NULL)
+	{
+		scheduleTimer.records = schedule.size();
+		scheduleTimer.bytesRead = getFileSize(savedir + "/schedule.ehm");
+	}
+	scheduleTimer.stop();
+
+	PhaseTimer readTimer(stats, "team_file_reads");
+	teamFiles.wait();
+	for(size_t team = 0; team < NTEAMS; team++) readTimer.bytesRead += teamFiles[team].bytes.size();
+	readTimer.records = NTEAMS;
+	readTimer.stop();
+
+	vector<size_t> unloggedGames;
+	verifyCapHistory(capdirectory, teamFiles, schedule, ngamesPlayed, playerCaps, npcs, players, matches,
+		nthreads, unloggedGames, capTeams, stats);
+	for(size_t i = 0; i < unloggedGames.size(); i++)
+	{
+		gameDays.push_back(schedule[unloggedGames[i]].day);
+		gameMonths.push_back(schedule[unloggedGames[i]].month);
+		gameYears.push_back(schedule[unloggedGames[i]].year);
+	}
+
+	// Each team's cap lines and running cap only depend on that team, so
+	// they're worked out in parallel; the lines all go in one journaled commit
+	if(!capTeams.empty())
+	{
+		PhaseTimer timer(stats, "history_append");
+		CapJournal journal;
+		runTasks(NTEAMS, nthreads, [&](size_t team)
+		{
+			ostringstream lines;
+			lines.precision(0);
+			lines.setf(ios::fixed);
+			writeCapLines(gameDays,gameMonths,gameYears,capTeams,team,model.teams[team],lines,playerCaps);
+			journal.lines[team] = lines.str();
+			journal.sizes[team] = teamFiles[team].bytes.size();
+		});
+		commitCapHistory(capdirectory, teamFiles, journal, stats);
+		timer.records = capTeams.size();
+		for(size_t team = 0; team < NTEAMS; team++) timer.bytesWritten += journal.lines[team].size();
+	}
+
+	PhaseTimer runningTimer(stats, "running_cap");
+	uint64_t scanned[NTEAMS] = {0};
+	exception_ptr capErrors[NTEAMS];
+	runTasks(NTEAMS, NIOTHREADS, [&](size_t team)
+	{
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		try
+		{
+			model.project(team, gamesPlayed[team], getRunningCap(gamesPlayed[team], teamFiles[team], &scanned[team]));
+		}
+		catch(...)
+		{
+			// rethrown once the rows before it are written
+			capErrors[team] = current_exception();
+		}
+		if(stats != NULL)
+		{
+			stats->addTeamTime("running_cap", team, chrono::duration<double>(chrono::steady_clock::now() - start).count());
+		}
+	});
+	for(size_t team = 0; team < NTEAMS; team++)
+	{
+		runningTimer.records += gamesPlayed[team];
+		runningTimer.bytesRead += scanned[team];
+	}
+	runningTimer.stop();
+
+	PhaseTimer reportTimer(stats, "report_writing");
+	ofstream capFile(capdirectory + "/caphits.txt");
+	capFile << "TEAM  TEAMID  GP  TODAY     TODATE    PENALTIES LTIR      PROJECTED OVER_CAP CONTR  MAXCAP    CAPSPACE" << endl;
+
+	for(size_t team = 0; team < NTEAMS; team++)
+	{
+		if(capErrors[team]) rethrow_exception(capErrors[team]);
+		capFile << capHitsRow(model.teams[team], team) << endl;
+	}
+
+	reportTimer.records = NTEAMS;
+	reportTimer.bytesWritten = capFile.tellp();
+	capFile.close();
+}
+
+void readPenalties(const char * filename, caphit * out)
+{
+	ifstream file;
+	file.open(filename);
+	std::string teamname;
+	std::string line;
+	for(size_t i = 0; i < NTEAMS; i++)
+	{
+		double total = 0;
+		std::getline(file, line);
+		std::stringstream ss(line);
+		ss >> teamname;
+		if(teamname != TEAMNAMES[i])
+		{
+			throw std::runtime_error("Error! Team " +
+				teamname + "!=team[" + to_string(i) +
+				"]=" + TEAMNAMES[i] + " in file " +
+				filename + "; aborting.");
+		}
+		double penalty;
+		while(ss >> penalty)
+		{
+			total += penalty;
+		}
+		out[i] = total;
+	}
+	file.close();
+}
+
+// Column names written as the first row of a CSV conversion
+const string CSVCOLUMNS = PlayerTable::csvColumns();
+
+// Starts reading CSV players, skipping the column names of an EHM->CSV conversion
+bool firstCSVRow(CSVReader & rows)
+{
+	bool more = rows.nextRow();
+	if(more && rows.peekQuoted())
+	{
+		rows.finishRow();
+		more = rows.nextRow();
+	}
+	return more;
+}
+
+/*
+ * A fixed size queue between threads: push waits while it's full and pop
+ * while it's empty. Once closed, push drops items and returns false, and pop
+ * returns false when nothing is left.
+ */
+template<typename T>
+class BoundedQueue
+{
+	private:
+		deque<T> items;
+		const size_t capacity;
+		bool closed;
+		mutex lock;
+		condition_variable notFull;
+		condition_variable notEmpty;
+
+	public:
+		BoundedQueue(size_t iCapacity) : capacity(iCapacity), closed(false)
+		{
+			;
+		}
+
+		bool push(T item)
+		{
+			unique_lock<mutex> guard(lock);
+			while(!closed && items.size() >= capacity) notFull.wait(guard);
+			if(closed) return false;
+			items.push_back(move(item));
+			notEmpty.notify_one();
+			return true;
+		}
+
+		bool pop(T & item)
+		{
+			unique_lock<mutex> guard(lock);
+			while(!closed && items.empty()) notEmpty.wait(guard);
+			if(items.empty()) return false;
+			item = move(items.front());
+			items.pop_front();
+			notFull.notify_one();
+			return true;
+		}
+
+		void close()
+		{
+			lock_guard<mutex> guard(lock);
+			closed = true;
+			notFull.notify_all();
+			notEmpty.notify_all();
+		}
+};
+
+/*
+ * Reads players.ehm records from a stream through a window of it that's
+ * topped up whenever less than MARGIN bytes are left, which is far more than
+ * a record takes, so each record is parsed from memory like a mapped file.
+ */
+class EHMStreamReader
+{
+	private:
+		static const size_t BLOCKSIZE = 1 << 20;
+		static const size_t MARGIN = 1 << 16;
+
+		istream & input;
+		vector<char> buffer;
+		size_t pos;
+		size_t dataEnd;
+
+		void fill()
+		{
+			if(dataEnd - pos >= MARGIN || !input) return;
+			memmove(buffer.data(), buffer.data() + pos, dataEnd - pos);
+			dataEnd -= pos;
+			pos = 0;
+			while(dataEnd < buffer.size() && input)
+			{
+				input.read(buffer.data() + dataEnd, buffer.size() - dataEnd);
+				dataEnd += input.gcount();
+			}
+		}
+
+	public:
+		EHMStreamReader(istream & iInput) : input(iInput), buffer(BLOCKSIZE), pos(0), dataEnd(0)
+		{
+			;
+		}
+
+		size_t readCount()
+		{
+			fill();
+			EHMTokenizer tokens(buffer.data() + pos, buffer.data() + dataEnd);
+			size_t count = tokens.readInt<size_t>();
+			pos = tokens.position() - buffer.data();
+			return count;
+		}
+
+		void readRecord(PlayerTable & table)
+		{
+			fill();
+			EHMTokenizer tokens(buffer.data() + pos, buffer.data() + dataEnd);
+			table.appendEHM(tokens);
+			pos = tokens.position() - buffer.data();
+		}
+};
+
+// Consecutive rows of a streamed conversion
+struct PlayerBatch
+{
+	size_t first;
+	PlayerTable table;
+};
+
+/*
+ * Converts between CSV and EHM without keeping the whole file: one thread
+ * parses batches of BATCHROWS players, another formats them and this one
+ * writes them out, with at most QUEUEDEPTH batches waiting between each, so
+ * memory use doesn't depend on the file size. "-" reads stdin or writes
+ * stdout. The EHM player count goes before the records, so EHM written to a
+ * file gets it patched in at the end as usual, while EHM written to stdout
+ * is spooled to a temporary file first. Returns the number of players.
+ */
+size_t streamConversion(const string & inputFilename, const string & outputFilename, bool isCSV)
+{
+	const size_t BATCHROWS = 4096;
+	const size_t QUEUEDEPTH = 4;
+
+	ifstream inputFile;
+	if(inputFilename != "-")
+	{
+		inputFile.open(inputFilename.c_str(), ios::binary);
+		if(!inputFile.is_open()) throw runtime_error("Error! Couldn't open " + inputFilename + "; aborting.");
+	}
+	istream & input = inputFilename == "-" ? cin : inputFile;
+
+	// EHM can only be written to stdout through a spool file
+	const bool toStdout = outputFilename == "-";
+	string spoolFilename;
+	if(toStdout && isCSV)
+	{
+		char directory[MAX_PATH];
+		char filename[MAX_PATH];
+		if(!GetTempPathA(MAX_PATH, directory) || !GetTempFileNameA(directory, "ehm", 0, filename))
+		{
+			throw runtime_error("Error! Couldn't create a temporary file to spool EHM output; aborting.");
+		}
+		spoolFilename = filename;
+	}
+	ofstream outputFile;
+	if(!toStdout || isCSV) outputFile.open((toStdout ? spoolFilename : outputFilename).c_str());
+	ostream & output = toStdout && !isCSV ? cout : outputFile;
+
+	BoundedQueue<PlayerBatch> parsed(QUEUEDEPTH);
+	BoundedQueue<string> formatted(QUEUEDEPTH);
+	exception_ptr parseError;
+	exception_ptr formatError;
+	size_t nplayers = 0;
+
+	thread parser([&]()
+	{
+		try
+		{
+			PlayerBatch batch;
+			batch.first = 0;
+			if(isCSV)
+			{
+				CSVReader rows(input, ',');
+				for(bool more = firstCSVRow(rows); more; more = rows.nextRow())
+				{
+					batch.table.appendCSV(rows);
+					rows.finishRow();
+					if(batch.table.size() == BATCHROWS)
+					{
+						size_t next = batch.first + BATCHROWS;
+						if(!parsed.push(move(batch))) break;
+						batch = PlayerBatch();
+						batch.first = next;
+					}
+				}
+			}
+			else
+			{
+				EHMStreamReader records(input);
+				const size_t nplayers = records.readCount();
+				for(size_t i = 0; i < nplayers; i++)
+				{
+					records.readRecord(batch.table);
+					if(batch.table.size() == BATCHROWS)
+					{
+						size_t next = batch.first + BATCHROWS;
+						if(!parsed.push(move(batch))) break;
+						batch = PlayerBatch();
+						batch.first = next;
+					}
+				}
+			}
+			nplayers = batch.first + batch.table.size();
+			if(batch.table.size() > 0) parsed.push(move(batch));
+		}
+		catch(...)
+		{
+			parseError = current_exception();
+		}
+		parsed.close();
+	});
+
+	thread formatter([&]()
+	{
+		try
+		{
+			ostringstream text;
+			PlayerBatch batch;
+			while(parsed.pop(batch))
+			{
+				{
+					OutputBuffer out(text);
+					for(size_t row = 0; row < batch.table.size(); row++)
+					{
+						if(isCSV) batch.table.outputDataEHM(row, out);
+						else batch.table.outputDataCSV(row, out, batch.first + row);
+					}
+				}
+				if(!formatted.push(text.str())) break;
+				text.str("");
+			}
+		}
+		catch(...)
+		{
+			formatError = current_exception();
+		}
+		// stop the parser too if this ended early
+		parsed.close();
+		formatted.close();
+	});
+
+	if(isCSV) output << "         \n";
+	else output << CSVCOLUMNS << "\n";
+	string text;
+	while(formatted.pop(text))
+	{
+		output.write(text.data(), text.size());
+		if(!output)
+		{
+			formatted.close();
+			parsed.close();
+		}
+	}
+	parser.join();
+	formatter.join();
+
+	const bool failed = parseError || formatError || !output;
+	if(isCSV && !failed)
+	{
+		outputFile.seekp(0, ios_base::beg);
+		outputFile << " " << nplayers << " ";
+	}
+	outputFile.close();
+	if(!spoolFilename.empty())
+	{
+		if(!failed)
+		{
+			ifstream spool(spoolFilename.c_str());
+			cout << spool.rdbuf();
+			cout.flush();
+		}
+		DeleteFileA(spoolFilename.c_str());
+	}
+
+	if(parseError) rethrow_exception(parseError);
+	if(formatError) rethrow_exception(formatError);
+	if(failed) throw runtime_error("Error! Couldn't write " + outputFilename + "; aborting.");
+	return nplayers;
+}
+
+// Settings given as --name=value arguments, which can go anywhere on the command line
+struct Options
+{
+	unsigned int threads;
+	bool snapshots;
+	bool streaming;
+	bool watch;
+	string batch;
+	// synthetic league size for --bench, no benchmarks when 0
+	size_t benchPlayers;
+	size_t benchTeams;
+	string benchDirectory;
+	// --stats: where to write them ("-" for stdout), and what they're kept in while running
+	bool keepStats;
+	string statsFilename;
+	RunStats * stats;
+	// --grid: salary model grid output file, brackets file (formula if empty) and each axis's min, max and step
+	string gridFilename;
+	string gridBrackets;
+	double gridOveralls[3];
+	double gridSalaries[3];
+	// --cap-model: also write the cap reports' figures as cap_model.csv and cap_model.json
+	bool capModel;
+
+	Options() : threads(1), snapshots(false), streaming(false), watch(false), benchPlayers(0),
+		benchTeams(NTEAMS), benchDirectory("bench"), keepStats(false), statsFilename("-"), stats(NULL), capModel(false)
+	{
+		const double overalls[3] = {65, 90, 0.1};
+		const double salaries[3] = {0.4, 9, 0.01};
+		copy(overalls, overalls + 3, gridOveralls);
+		copy(salaries, salaries + 3, gridSalaries);
+	}
+};
+
+// Reads MIN:MAX:STEP into range, exiting on anything else
+void parseGridRange(const string & option, const string & value, double range[3])
+{
+	char extra;
+	if(sscanf(value.c_str(), "%lf:%lf:%lf%c", &range[0], &range[1], &range[2], &extra) != 3 ||
+		!(range[2] > 0) || !(range[1] >= range[0]))
+	{
+		cerr << "Error! " << option << " needs MIN:MAX:STEP with MIN <= MAX and STEP > 0" << endl;
+		exit(EXIT_FAILURE);
+	}
+}
+
+void writeStats(RunStats & stats, const Options & options)
+{
+	if(options.statsFilename == "-")
+	{
+		stats.write(cout);
+		return;
+	}
+	ofstream statsFile(options.statsFilename.c_str());
+	if(!statsFile.is_open())
+	{
+		cerr << "Error! Couldn't write stats to " << options.statsFilename << endl;
+		return;
+	}
+	stats.write(statsFile);
+}
+
+// Removes the --name=value arguments from argv, leaving the positional ones in order
+void parseOptions(int & argc, char * argv[], Options & options)
+{
+	int positional = 1;
+	for(int arg = 1; arg < argc; arg++)
+	{
+		string option = argv[arg];
+		if(option.compare(0, 2, "--") != 0)
+		{
+			argv[positional++] = argv[arg];
+			continue;
+		}
+		size_t equals = option.find('=');
+		string name = option.substr(2, equals == string::npos ? string::npos : equals-2);
+		string value = equals == string::npos ? "" : option.substr(equals+1);
+		if(name == "threads")
+		{
+			int threads = atoi(value.c_str());
+			options.threads = threads > 0 ? threads : max(1u, thread::hardware_concurrency());
+		}
+		else if(name == "snapshot")
+		{
+			options.snapshots = value != "0";
+		}
+		else if(name == "stream")
+		{
+			options.streaming = value != "0";
+		}
+		else if(name == "batch")
+		{
+			options.batch = value;
+		}
+		else if(name == "watch")
+		{
+			options.watch = value != "0";
+		}
+		else if(name == "bench")
+		{
+			options.benchPlayers = value.empty() ? 100000 : atoi(value.c_str());
+		}
+		else if(name == "bench-teams")
+		{
+			options.benchTeams = atoi(value.c_str());
+		}
+		else if(name == "bench-dir")
+		{
+			options.benchDirectory = value;
+		}
+		else if(name == "grid")
+		{
+			options.gridFilename = value;
+		}
+		else if(name == "grid-brackets")
+		{
+			options.gridBrackets = value;
+		}
+		else if(name == "grid-overall")
+		{
+			parseGridRange(option, value, options.gridOveralls);
+		}
+		else if(name == "grid-salary")
+		{
+			parseGridRange(option, value, options.gridSalaries);
+		}
+		else if(name == "cap-model")
+		{
+			options.capModel = value != "0";
+		}
+		else if(name == "stats")
+		{
+			options.keepStats = true;
+			options.statsFilename = value.empty() ? "-" : value;
+		}
+		else
+		{
+			cerr << "Error! Unknown option " << option << endl;
+			exit(EXIT_FAILURE);
 		}
-		outputFile << endl;
 	}
+	argc = positional;
+}
 
-	outputFile << "RFA List:" << endl;
+// Caps or cap relief per team, as read by readPenalties
+struct TeamAmounts
+{
+	caphit amounts[NTEAMS];
+};
 
-	for(size_t player = 0; player < nplayers; player++)
-	{
-		double age = players[player].getAge(2012,7,1);
-		bool isRFA = players[player].getContractLength() == 1 && age < 31;
-		if(isRFA)
+/*
+ * Files parsed once and then shared read-only, by key (usually the
+ * filename). The first caller of get for a key parses the file while the
+ * others wait; if parsing throws, the next caller tries again. A file whose
+ * size or write time has changed since is parsed again.
+ */
+template<typename T>
+class SharedFiles
+{
+	private:
+		struct Entry
 		{
-			const Player & currPlayer = players[player];
-			double overall = rater.getOverall(currPlayer);
-			if(overall > 65)
-			{
-				if(currPlayer.getLastName().compare("Backes") == 0)
-				{
-					int x = 5;
-					x+=2;
-				}
+			once_flag parsed;
+			shared_ptr<const T> value;
+			uint64_t size;
+			uint64_t mtime;
+		};
 
-				double off = rater.getOFF(currPlayer);
-				double def = rater.getDEF(currPlayer);
-				double specialistBonus = 500000*(off >= (def+5)) + 250000*(def >= (off+5));
+		mutex lock;
+		map<string, shared_ptr<Entry> > entries;
 
-				if(useBrackets)
-				{
-					outputNewSalaryInfo(currPlayer, overall, outputFile, brackets, specialistBonus);
-				}
-				else
+	public:
+		template<typename Parse>
+		shared_ptr<const T> get(const string & key, const string & filename, Parse parse)
+		{
+			uint64_t size = 0;
+			uint64_t mtime = 0;
+			getFileStamp(filename, size, mtime);
+			shared_ptr<Entry> entry;
+			{
+				lock_guard<mutex> guard(lock);
+				shared_ptr<Entry> & slot = entries[key];
+				if(!slot || slot->size != size || slot->mtime != mtime)
 				{
-					outputNewSalaryInfo(currPlayer, overall, outputFile);
+					slot = make_shared<Entry>();
+					slot->size = size;
+					slot->mtime = mtime;
 				}
+				entry = slot;
 			}
+			call_once(entry->parsed, [&]()
+			{
+				entry->value = parse();
+			});
+			return entry->value;
 		}
+};
+
+// Everything a run reads that other runs in the same batch might read too
+struct SharedInputs
+{
+	SharedFiles<PlayerTable> players;
+	SharedFiles<TeamAmounts> teamAmounts;
+	SharedFiles<vector<OverallWeights> > overallWeights;
+	SharedFiles<SalaryBrackets> brackets;
+
+	shared_ptr<const PlayerTable> getPlayers(const string & filename, bool countLine, size_t nplayers,
+		const Options & options)
+	{
+		return players.get(filename + (countLine ? "" : "#" + to_string(nplayers)), filename, [&]()
+		{
+			shared_ptr<PlayerTable> table = make_shared<PlayerTable>();
+			loadPlayerFile(filename, countLine, nplayers, *table, options.threads, options.snapshots);
+			return shared_ptr<const PlayerTable>(table);
+		});
 	}
-}
 
-double getCapLine(ifstream & teamCapFile, int day, int month, int year, Player * playerCaps[], int npcs,
-	const vector<Player> & players, int pcs, ofstream & checkFile)
+	shared_ptr<const TeamAmounts> getTeamAmounts(const string & filename)
+	{
+		return teamAmounts.get(filename, filename, [&]()
+		{
+			shared_ptr<TeamAmounts> amounts = make_shared<TeamAmounts>();
+			readPenalties(filename.c_str(), amounts->amounts);
+			return shared_ptr<const TeamAmounts>(amounts);
+		});
+	}
+
+	shared_ptr<const vector<OverallWeights> > getOverallWeights(const string & filename)
+	{
+		return overallWeights.get(filename, filename, [&]()
+		{
+			return make_shared<const vector<OverallWeights> >(readOverallWeights(filename));
+		});
+	}
+
+	shared_ptr<const SalaryBrackets> getBrackets(const string & filename)
+	{
+		return brackets.get(filename, filename, [&]()
+		{
+			ifstream bracketFile(filename.c_str());
+			return shared_ptr<const SalaryBrackets>(make_shared<SalaryBrackets>(bracketFile));
+		});
+	}
+};
+
+/*
+ * Reads the players in args[1] and writes them to args[2] in the other
+ * format (EHM when args[3] says the input is CSV).
+ */
+shared_ptr<const PlayerTable> convertPlayers(const vector<string> & args, SharedInputs & inputs,
+	const Options & options)
 {
-	if(teamCapFile.is_open() && !(teamCapFile.eof() || teamCapFile.peek() == EOF))
+	ofstream outputFile;
+	outputFile.open(args[2].c_str());
+
+	const string & CSV = args[3];
+	const bool isCSV = (CSV == "1" || CSV == "T" || CSV == "true" || CSV == "True");
+
+	if(isCSV)
 	{
-		int iDay;
-		teamCapFile >> iDay;
-		if(iDay != day)
+		// Rows are converted as they're parsed, so this is one phase
+		PhaseTimer timer(options.stats, "players_parse");
+		shared_ptr<PlayerTable> players = make_shared<PlayerTable>();
+		size_t nplayers = 0;
+
+		ifstream inputFile;
+		inputFile.open(args[1].c_str(), ios::binary);
+		CSVReader rows(inputFile, ',');
+		OutputBuffer output(outputFile);
+
+		output << "         \n";
+		bool more = firstCSVRow(rows);
+		while(more)
 		{
-			assert(iDay == day);
+			players->appendCSV(rows);
+			players->outputDataEHM(nplayers, output);
+			nplayers++;
+			rows.finishRow();
+			more = rows.nextRow();
 		}
-		int iMonth;
-		teamCapFile >> iMonth;
-		assert(iMonth == month);
-		int iYear;
-		teamCapFile >> iYear;
-		assert(iYear == year);
+		output.flush();
+		outputFile.seekp(0, ios_base::beg);
+		outputFile << " " << nplayers << " ";
 
-		caphit teamcap;
-		teamCapFile >> teamcap;
+		inputFile.close();
+		if(options.stats != NULL)
+		{
+			outputFile.seekp(0, ios_base::end);
+			timer.records = nplayers;
+			timer.bytesRead = getFileSize(args[1]);
+			timer.bytesWritten = outputFile.tellp();
+		}
+		return players;
+	}
 
-		caphit penalties;
-		teamCapFile >> penalties;
+	PhaseTimer parseTimer(options.stats, "players_parse");
+	shared_ptr<const PlayerTable> players = inputs.getPlayers(args[1], true, 0, options);
+	if(options.stats != NULL)
+	{
+		parseTimer.records = players->size();
+		parseTimer.bytesRead = getFileSize(args[1]);
+	}
+	parseTimer.stop();
 
-		caphit ltir;
-		teamCapFile >> ltir;
+	PhaseTimer writeTimer(options.stats, "conversion_write");
+	outputFile << CSVCOLUMNS << std::endl;
+	OutputBuffer output(outputFile);
+	for(uint i = 0; i < players->size(); i++)
+	{
+		players->outputDataCSV(i, output, i);
+	}
+	if(options.stats != NULL)
+	{
+		output.flush();
+		writeTimer.records = players->size();
+		writeTimer.bytesWritten = outputFile.tellp();
+	}
+	return players;
+}
 
-		int nplayers;
-		teamCapFile >> nplayers;
+/*
+ * The cap reports for the optional arguments from args[4] on: the start of
+ * season file, cap directory, penalty and LTIR files, save directory, and
+ * the RFA salary file with its overall weights and brackets.
+ */
+void capReports(const vector<string> & args, const PlayerTable & players, SharedInputs & inputs,
+	const Options & options, ReportCache * cache = NULL)
+{
+	const size_t argc = args.size();
+	const size_t nplayers = players.size();
 
-		for(int p = 0; p < nplayers; p++)
-		{
-			int id; teamCapFile >> id;
-			int team; teamCapFile >> team;
-			string firstName; teamCapFile >> firstName;
-			string lastName; teamCapFile >> lastName;
-			double salary; teamCapFile >> salary;
+	// The start of season file is read from the top, player count line included
+	PhaseTimer parseTimer(options.stats, "start_of_season_parse");
+	shared_ptr<const PlayerTable> playerCapsFile = inputs.getPlayers(args[4], false, nplayers, options);
+	const PlayerTable & playerCaps = *playerCapsFile;
+	parseTimer.records = playerCaps.size();
+	parseTimer.bytesRead = options.stats != NULL ? getFileSize(args[4]) : 0;
+	parseTimer.stop();
 
-			int oldsal = 0;
-			int currsal = 0;
-			if(id >= 0)
+	vector<size_t> capPlayers[NTEAMS];
+
+	for(size_t i = 0; i < nplayers; i++)
+	{
+		int team = playerCaps.getRights(i);
+		bool ahl = team > NTEAMS && team <= 2*NTEAMS;
+
+		// Add AHL players too
+		if((((team > 0) && (team <= NTEAMS)) || ahl) && playerCaps.getContractLength(i) > 0)
+		{
+			capPlayers[team-1-ahl*NTEAMS].push_back(i);
+			/*
+			if(players[i]->getContractLength() == 0)
 			{
-				if(id < npcs) oldsal = playerCaps[id]->getSalary();
-				if(id < pcs) currsal = players[id].getSalary();
+				capPlayers[team-1].push_back(players[i]);
 			}
-
-			bool matchedSalary = (oldsal == salary || currsal == salary);
-			if(!matchedSalary)
+			else
 			{
-				checkFile << "Mismatch game " << iDay << "/" << iMonth <<
-					"/" << iYear << " playerid " << id << " salary " <<
-					salary	<< " old file " << oldsal << " current file " <<
-					currsal << endl;
+				capPlayers[team-1].push_back(playerCaps[i]);
 			}
+			*/
 		}
+	}
 
-		string temp;
-		getline(teamCapFile,temp);
+	ofstream capOutfile;
+	string capdir = args[5];
 
-		if(!temp.empty())
-		{
-			throw runtime_error("Error! Team cap file EOL is " + temp +
-				" instead of empty; aborting.");
-		}
+	caphit penalties[NTEAMS];
+	shared_ptr<const TeamAmounts> penaltiesFile;
 
-		return teamcap;
+	if(argc > 6)
+	{
+		penaltiesFile = inputs.getTeamAmounts(args[6]);
+		copy(penaltiesFile->amounts, penaltiesFile->amounts + NTEAMS, penalties);
+	}
+	else
+	{
+		for(int i = 0; i < NTEAMS; i++) penalties[i] = 0;
 	}
-	return 0;
-}
 
-double getAdjustedCap(double caphit, double penalties, double ltir, double maxcap)
-{
-	caphit = caphit + penalties;
-	if(caphit > maxcap)
+	caphit ltir[NTEAMS];
+
+	if(argc > 7)
 	{
-		caphit = max(maxcap,caphit-ltir);
+		shared_ptr<const TeamAmounts> amounts = inputs.getTeamAmounts(args[7]);
+		copy(amounts->amounts, amounts->amounts + NTEAMS, ltir);
+	}
+	else
+	{
+		for(size_t i = 0; i < NTEAMS; i++) ltir[i] = 0;
 	}
-	return caphit;
-}
 
-bool isPro(size_t team)
-{
-	return team > 0 && team <= 2*NTEAMS;
-}
+	if(argc > 8)
+	{
+		string savedir = args[8];
+
+		// The date is read once here for every report
+		string leagueFile = savedir + "/league.ehm";
+		ifstream league(leagueFile);
+
+		int year = 0; int month = 0; int day = 0;
+		league >> year;
+		league >> month;
+		league >> day;
+
+		ReportCache uncached;
+		ReportCache & teamCaps = cache != NULL ? *cache : uncached;
+		teamCaps.use(playerCapsFile, penaltiesFile);
+		CapModel & model = teamCaps.model;
+		if(!teamCaps.haveModel)
+		{
+			PhaseTimer timer(options.stats, "team_cap_hits");
+			timer.records = NTEAMS;
+			const PlayerCapHits capHits(playerCaps);
+			runTasks(NTEAMS, options.threads, [&](size_t team)
+			{
+				model.teams[team] = getTeamCap(capHits, capPlayers[team]);
+			});
+			teamCaps.haveModel = true;
+		}
+		model.year = year;
+		model.month = month;
+		model.day = day;
+		// Tally up penalties and LTIR separately
+		model.setAmounts(penalties, ltir);
 
-bool isNHL(size_t team)
-{
-	return team > 0 && team <= NTEAMS;
-}
+		PhaseTimer matchTimer(options.stats, "player_matching");
+		PlayerMatches matches = matchPlayers(playerCaps, players);
+		writePlayerMatches(capdir + "/" + "player_matches.txt", playerCaps, matches);
+		matchTimer.records = playerCaps.size();
+		matchTimer.stop();
 
-bool isAHL(size_t team)
-{
-	return team > NTEAMS && team <= 2*NTEAMS;
-}
+		calcSalariesFromSchedule(savedir, capdir, model, playerCaps, nplayers, players, matches,
+			options.threads, options.stats);
 
-bool isPro(const Player & p)
-{
-	return(isPro(p.getTeam()));
-}
+		PhaseTimer reportTimer(options.stats, "report_writing");
+		capOutfile.open((capdir + "/" + "caps.txt").c_str());
 
-bool isNHL(const Player & p)
-{
-	return(isNHL(p.getTeam()));
-}
+		// Teams are sorted and formatted in parallel, then written in order
+		string * capTexts = teamCaps.capsTexts;
+		if(!teamCaps.haveCaps) runTasks(NTEAMS, options.threads, [&](size_t i)
+		{
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			capTexts[i] = capsText(model.teams[i], i, playerCaps);
+			if(options.stats != NULL)
+			{
+				options.stats->addTeamTime("caps_report", i,
+					chrono::duration<double>(chrono::steady_clock::now() - start).count());
+			}
+		});
+		teamCaps.haveCaps = true;
 
-bool isAHL(const Player & p)
-{
-	return(isAHL(p.getTeam()));
-}
+		for(size_t i = 0; i < NTEAMS; i++)
+		{
+			capOutfile << capTexts[i];
+			reportTimer.records += model.teams[i].players.size();
+			reportTimer.bytesWritten += capTexts[i].size();
+		}
 
+		capOutfile.close();
 
-caphit getPlayerCapHit(const Player & player, int year, int month, int day)
-{
-	bool nhl = isNHL(player);
-	bool ahl = isAHL(player);
-	return max(caphit(0), player.getSalary()*(nhl ||
-		(ahl && (player.getAge(YEAR_FIRST, 9, 15) >= WAIVERAGE)))
-		- MAXAHLSALARY*ahl);
-}
+		if(options.capModel)
+		{
+			ofstream csvFile((capdir + "/cap_model.csv").c_str());
+			writeCapModelCSV(model, csvFile);
+			reportTimer.bytesWritten += csvFile.tellp();
+			ofstream jsonFile((capdir + "/cap_model.json").c_str());
+			writeCapModelJSON(model, playerCaps, jsonFile);
+			reportTimer.bytesWritten += jsonFile.tellp();
+		}
+	}
 
-pair<caphit, size_t> getCapHits(const vector<Player*> & capPlayers, caphit penalty, int year, int month, int day)
-{
-	vector<Player*>::const_iterator it;
-	caphit cap = 0;
-	size_t npro = 0;
-	size_t ncon = 0;
-	for (it=capPlayers.begin(); it!=capPlayers.end(); ++it)
+	if(argc > 9)
 	{
-		const Player & p = **it;
-		const size_t pteam = p.getTeam();
-		//string lname = (**it).getLastName();
-		if(pteam <= 2*NTEAMS)
+		PhaseTimer timer(options.stats, "salary_grid");
+		timer.records = nplayers;
+		string salaryFilename = args[9];
+		shared_ptr<const vector<OverallWeights> > weights = inputs.getOverallWeights(args[10]);
+
+		if(argc > 11)
+		{
+			shared_ptr<const SalaryBrackets> brackets = inputs.getBrackets(args[11]);
+			outputNewSalariesInfo(players, nplayers, salaryFilename, *weights, brackets.get());
+		}
+		else
 		{
-			cap += getPlayerCapHit(p, year, month, day);
-			ncon += isPro(pteam);
+			outputNewSalariesInfo(players, nplayers, salaryFilename, *weights, NULL);
 		}
-		npro += isNHL(pteam);
+		if(options.stats != NULL) timer.bytesWritten = getFileSize(salaryFilename);
 	}
-	cout << npro << " " << (npro < MINNPRO) << " " << cap << endl;
-	if(npro < MINNPRO) cap += (MINNPRO - npro)*MINCAPHITCURR;
-	return {cap + penalty, ncon};
 }
 
-void writeCapLines(vector<int> gameDays, vector<int> gameMonths, vector<int> gameYears,
-		vector<int> capTeams, caphit caphits[NTEAMS], size_t ncontracts[NTEAMS],
-		ofstream teamOFiles[NTEAMS], vector<Player*> capPlayers[NTEAMS],
-		caphit penalties[NTEAMS], caphit ltir[NTEAMS])
+/*
+ * Runs every line of a manifest as if it were the positional arguments of
+ * its own run (save directory 8th, output directories 2nd and 5th), with
+ * blank lines and lines starting with # skipped. Jobs take turns on a pool
+ * of --threads workers and share whatever input files they have in common,
+ * except that jobs with the same cap directory run in manifest order.
+ * A job that fails is reported and the rest carry on; the exit status says
+ * whether any failed.
+ */
+int runBatch(const string & manifestFilename, const Options & options)
 {
-	unsigned int entries = capTeams.size();
-	assert(entries == gameDays.size());
-	assert(entries == gameMonths.size());
-	assert(entries == gameYears.size());
-	for(unsigned int entry = 0; entry < entries; entry++)
+	ifstream manifest(manifestFilename.c_str());
+	if(!manifest.is_open())
 	{
-		int team = capTeams.at(entry);
-		ofstream & ofile = teamOFiles[team];
-		ofile << gameDays.at(entry) << " ";
-		ofile << gameMonths.at(entry) << " ";
-		ofile << gameYears.at(entry) << " ";
-		ofile << caphits[team] << " ";
-		ofile << penalties[team] << " ";
-		ofile << ltir[team] << " ";
-		ofile << capPlayers[team].size();
+		cerr << "Error! Couldn't open batch manifest " << manifestFilename << endl;
+		return EXIT_FAILURE;
+	}
+
+	vector<vector<string> > jobs;
+	string line;
+	while(getline(manifest, line))
+	{
+		stringstream words(line);
+		vector<string> args(1, "filereader");
+		string word;
+		while(words >> word) args.push_back(word);
+		if(args.size() == 1 || args[1][0] == '#') continue;
+		jobs.push_back(args);
+	}
 
-		vector<Player*>::const_iterator it;
+	struct JobResult
+	{
+		string error;
+		double seconds;
+	};
+	vector<JobResult> results(jobs.size());
+	SharedInputs inputs;
 
-		for (it=capPlayers[team].begin(); it!=capPlayers[team].end(); ++it)
+	/*
+	 * Jobs writing to the same cap directory share its team files, indexes,
+	 * journal and reports, so they run one after another in manifest order;
+	 * only separate cap directories (or none) run at the same time
+	 */
+	vector<vector<size_t> > groups;
+	map<string, size_t> capGroups;
+	for(size_t job = 0; job < jobs.size(); job++)
+	{
+		if(jobs[job].size() > 5)
 		{
-			const Player & p = **it;
-			string lastname = p.getLastName();
-			bool done = false;
-			while(!done)
+			string capdir = jobs[job][5];
+			replace(capdir.begin(), capdir.end(), '\\', '/');
+			while(capdir.size() > 1 && capdir[capdir.size()-1] == '/') capdir.erase(capdir.size()-1);
+			transform(capdir.begin(), capdir.end(), capdir.begin(), ::tolower);
+			map<string, size_t>::const_iterator group = capGroups.find(capdir);
+			if(group != capGroups.end())
 			{
-				size_t position = lastname.find(" ");
-				if(position != string::npos)
-				{
-					lastname.replace(position,1,SPACEREPLACE);
-				}
-				else
+				groups[group->second].push_back(job);
+				continue;
+			}
+			capGroups[capdir] = groups.size();
+		}
+		groups.push_back(vector<size_t>(1, job));
+	}
+
+	// Threads left over when there are fewer groups than workers go to each job
+	Options jobOptions = options;
+	jobOptions.threads = max<size_t>(1, options.threads / max<size_t>(1, min<size_t>(groups.size(), options.threads)));
+
+	auto runJob = [&](size_t job)
+	{
+		chrono::steady_clock::time_point jobStart = chrono::steady_clock::now();
+		const vector<string> & args = jobs[job];
+		try
+		{
+			// a start of season file is no use without the cap directory after it
+			if(args.size() < 4 || args.size() == 5 || args.size() > 12)
+			{
+				throw runtime_error("Error! Job needs 3 arguments, or 5 to 11 with the cap directory 5th; skipping.");
+			}
+			shared_ptr<const PlayerTable> players = convertPlayers(args, inputs, jobOptions);
+			if(args.size() > 4)
+			{
+				DWORD attributes = GetFileAttributesA(args[5].c_str());
+				if(attributes == INVALID_FILE_ATTRIBUTES || !(attributes & FILE_ATTRIBUTE_DIRECTORY))
 				{
-					done = true;
+					throw runtime_error("Error! Directory " + args[5] + " does not exist; please create it first.");
 				}
+				capReports(args, *players, inputs, jobOptions);
 			}
-			ofile << " " << p.getId()  << " " << p.getTeam() << " " <<
-				p.getFirstName() << " " << lastname << " " <<
-				getPlayerCapHit(p, gameYears.at(entry),
-				gameMonths.at(entry), gameDays.at(entry));
 		}
+		catch(exception & e)
+		{
+			results[job].error = e.what();
+		}
+		results[job].seconds = chrono::duration<double>(chrono::steady_clock::now() - jobStart).count();
+	};
 
-		ofile << endl;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	runTasks(groups.size(), options.threads, [&](size_t group)
+	{
+		for(size_t i = 0; i < groups[group].size(); i++) runJob(groups[group][i]);
+	});
+	const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	size_t failed = 0;
+	for(size_t job = 0; job < jobs.size(); job++)
+	{
+		const vector<string> & args = jobs[job];
+		const JobResult & result = results[job];
+		cout << "Job " << job+1 << " " << (args.size() > 8 ? args[8] : args[1]) << ": " <<
+			(result.error.empty() ? "done" : "failed, " + result.error) << " in " << result.seconds << " s" << endl;
+		failed += !result.error.empty();
 	}
+	cout << jobs.size() - failed << " of " << jobs.size() << " jobs done, " << failed << " failed, in " <<
+		seconds << " s" << endl;
+	if(options.stats != NULL) writeStats(*options.stats, options);
+
+	return failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
-double getRunningCap(ifstream & teamCapFile, int gamesPlayed, std::string teamFilename)
+// Small deterministic generator for synthetic leagues, so benchmark runs compare
+struct BenchRandom
 {
-	double totalcap = 0;
-	int gamesCounted = 0;
-	if(teamCapFile.is_open())
-	{
-		bool keepReading = teamCapFile.peek() != EOF;
-		while(keepReading)
-		{
-			int iDay;
-			teamCapFile >> iDay;
-			int iMonth;
-			teamCapFile >> iMonth;
-			int iYear;
-			teamCapFile >> iYear;
-
-			double caphit;
-			teamCapFile >> caphit;
-			assert(caphit > 0);
+	uint64_t state;
 
-			double penalties;
-			teamCapFile >> penalties;
+	BenchRandom(uint64_t seed) : state(seed)
+	{
+		;
+	}
 
-			double ltir;
-			teamCapFile >> ltir;
+	int next(int low, int high)
+	{
+		state = state*6364136223846793005ULL + 1442695040888963407ULL;
+		return low + int((state >> 33) % uint64_t(high - low + 1));
+	}
+};
 
-			caphit = getAdjustedCap(caphit, penalties, ltir, MAXCAP);
+/*
+ * nplayers players in the CSV layout of the EHM->CSV conversion. The first
+ * ROSTER per team have contracts and rights with one of the first nteams
+ * teams, about as many as a real league; the rest are unsigned.
+ */
+string syntheticPlayersCSV(size_t nplayers, size_t nteams)
+{
+	const size_t ROSTER = 50;
+	const char * FIRSTNAMES[] = {"John", "Mike", "Sven", "Jean-Luc", "Pat", "Ilya", "Teemu", "Joe"};
+	const char * LASTNAMES[] = {"Smith", "Van der Berg", "O'Neil", "St. Louis", "Backes", "Lee", "De La Rose", "Kane"};
+	BenchRandom random(nplayers);
+	ostringstream csv;
+	for(size_t player = 0; player < nplayers; player++)
+	{
+		const bool signed_ = player < ROSTER*nteams;
+		const int team = signed_ ? int(player % nteams) + 1 : random.next(0, 2*NTEAMS);
+		for(int i = 0; i < 16; i++) csv << random.next(1, 99) << ",";
+		csv << random.next(0, 9) << "," << team << "," << random.next(0, 4) << "," << random.next(0, 30) << ",";
+		csv << random.next(0, 1) << "," << random.next(1985, 2006) << "," << random.next(1, 28) << ",";
+		csv << random.next(1, 12) << "," << (signed_ ? random.next(5, 20)*100000 : 0) << ",";
+		csv << (signed_ ? random.next(1, 5) : 0) << "," << random.next(2000, 2023) << ",";
+		csv << random.next(0, 7) << "," << random.next(0, 60) << "," << (signed_ ? team : 0) << ",";
+		for(size_t i = 0; i < 2*NPERFORMANCE + NRECORDS + NOPTIONS + NSTATUSES; i++)
+		{
+			csv << random.next(0, 9) << ",";
+		}
+		csv << "sc1 " << random.next(0, 9) << " " << random.next(0, 9) << ",sc2," << random.next(0, 9) << "  " <<
+			random.next(0, 9) << ",";
+		for(size_t i = 0; i < NMISC; i++) csv << random.next(-5, 9) << ",";
+		csv << random.next(150, 250) << "," << random.next(60, 80) << "," << random.next(0, 5) << ",";
+		for(size_t i = 0; i < NSTREAKS; i++) csv << random.next(0, 20) << ",";
+		csv << hex << uppercase << random.next(0x10000000, 0x7FFFFFFF) << dec << ",";
+		csv << FIRSTNAMES[random.next(0, 7)] << "," << LASTNAMES[random.next(0, 7)] << ",--,Drafted,";
+		for(int i = 0; i < 13; i++) csv << random.next(0, 110) << ",";
+		csv << "EHM 1.3," << random.next(-3, 5) << "," << random.next(0, 4) << "," << random.next(0, 60) << ",";
+		csv << random.next(0, 9) << "," << random.next(0, 300) << "\n";
+	}
+	return csv.str();
+}
 
-			totalcap += caphit;
+/*
+ * A season of NGAMES games for each of the first nteams teams, rotating
+ * pairings, nteams/2 games a day from October 1st with 28 day months, in
+ * schedule.ehm layout. Returns the number of games.
+ */
+size_t writeSyntheticSchedule(const string & filename, size_t nteams)
+{
+	ofstream schedule(filename.c_str());
+	const size_t ngames = nteams*NGAMES/2;
+	const size_t perDay = max<size_t>(1, nteams/2);
+	for(size_t game = 0; game < ngames; game++)
+	{
+		size_t day = game/perDay;
+		size_t round = day % (nteams - 1);
+		size_t slot = game % perDay;
+		// circle method: team nteams-1 stays put while the others rotate
+		size_t home = slot == 0 ? nteams - 1 : (round + slot) % (nteams - 1);
+		size_t away = (round + nteams - 1 - slot) % (nteams - 1);
+		int month = 10 + int(day/28);
+		int year = 2023 + (month > 12);
+		month = (month - 1) % 12 + 1;
+		schedule << int(day % 28) + 1 << " " << month << " " << year << " " << home + 1 << " " << away + 1 << " 1\n";
+		schedule << "0 0\n";
+	}
+	return ngames;
+}
 
-			string restLine;
-			getline(teamCapFile,restLine);
+/*
+ * Benchmarks (--bench): writes a synthetic league of nplayers players and
+ * nteams teams (players in both formats, a schedule and a season of team
+ * cap files) to directory, then times the hot spots on their own, each the
+ * best of REPEATS runs. Results are JSON, one object per line.
+ */
+int runBenchmarks(size_t nplayers, size_t nteams, const string & directory, const Options & options)
+{
+	const size_t REPEATS = 5;
+	const int YEAR = 2024;
+	const int MONTH = 1;
+	const int DAY = 15;
 
-			gamesCounted++;
+	if(nteams < 2 || nteams > NTEAMS)
+	{
+		cerr << "Error! Benchmarks need 2 to " << NTEAMS << " teams" << endl;
+		return EXIT_FAILURE;
+	}
+	CreateDirectoryA(directory.c_str(), NULL);
+	const string csv = syntheticPlayersCSV(nplayers, nteams);
 
-			keepReading = teamCapFile.peek() != EOF;
+	PlayerTable players;
+	{
+		istringstream input(csv);
+		CSVReader rows(input, ',');
+		for(bool more = firstCSVRow(rows); more; more = rows.nextRow())
+		{
+			players.appendCSV(rows);
+			rows.finishRow();
 		}
 	}
-	if(gamesCounted != gamesPlayed)
+	string ehm;
 	{
-		throw runtime_error("Error! Games counted " + to_string(gamesCounted) +
-			" doesn't match " + to_string(gamesPlayed) + "games played in file " +
-			teamFilename + "; aborting.");
+		ostringstream text;
+		OutputBuffer output(text);
+		// the count line as the CSV->EHM conversion pads it
+		string countLine = " " + to_string(nplayers) + " ";
+		if(countLine.size() < 9) countLine.resize(9, ' ');
+		output << countLine << "\n";
+		for(size_t row = 0; row < nplayers; row++)
+		{
+			players.outputDataEHM(row, output);
+		}
+		output.flush();
+		ehm = text.str();
 	}
-	return totalcap;
-}
+	ofstream((directory + "/players.csv").c_str(), ios::binary) << csv;
+	ofstream((directory + "/players.ehm").c_str(), ios::binary) << ehm;
 
-void calcSalariesFromSchedule(string savedir, string capdirectory, int nteams,
-	vector<Player*> capPlayers[NTEAMS], Player * playerCaps[], int npcs,
-	const std::vector<Player> & players, int pcs, caphit penalties[NTEAMS], caphit ltir[NTEAMS])
-{
-	string scheduleFile = savedir + "/schedule.ehm";
-	ifstream sched(scheduleFile);
+	vector<size_t> capPlayers[NTEAMS];
+	for(size_t row = 0; row < nplayers; row++)
+	{
+		int team = players.getRights(row);
+		if(team > 0 && size_t(team) <= nteams && players.getContractLength(row) > 0) capPlayers[team-1].push_back(row);
+	}
 
-	string leagueFile = savedir + "/league.ehm";
-	ifstream league(leagueFile);
+	const size_t ngames = writeSyntheticSchedule(directory + "/schedule.ehm", nteams);
+	ofstream((directory + "/league.ehm").c_str()) << YEAR << " " << MONTH << " " << DAY << endl;
+	Schedule schedule(directory + "/schedule.ehm");
+	const size_t played = schedule.countPlayed(YEAR, MONTH, DAY);
 
-	vector<int> gameMonths;
-	vector<int> gameDays;
-	vector<int> gameYears;
-	vector<int> capTeams;
+	const PlayerCapHits capHits(players);
 
-	int gamesPlayed[NTEAMS];
-	caphit caphits[NTEAMS];
-	ifstream teamFiles[NTEAMS];
+	// every played game logged in the team cap files, as a season's runs leave them
 	string teamFilenames[NTEAMS];
-	size_t ncontracts[NTEAMS];
-	for(size_t i = 0; i < NTEAMS; i++)
+	size_t teamGames[NTEAMS] = {0};
 	{
-		gamesPlayed[i] = 0;
-		caphits[i] = 0;
-		ncontracts[i] = 0;
-		teamFilenames[i] = capdirectory + "/" + TEAMNAMES[i] + ".txt";
-		teamFiles[i].open(teamFilenames[i].c_str());
-		bool success = teamFiles[i].is_open();
-		if(!success) teamFiles[i].close();
+		vector<int> days, months, years, teams;
+		for(size_t game = 0; game < played; game++)
+		{
+			const size_t sides[2] = {schedule[game].homeTeam, schedule[game].awayTeam};
+			for(size_t side = 0; side < 2; side++)
+			{
+				days.push_back(schedule[game].day);
+				months.push_back(schedule[game].month);
+				years.push_back(schedule[game].year);
+				teams.push_back(sides[side]);
+				teamGames[sides[side]]++;
+			}
+		}
+		for(size_t team = 0; team < nteams; team++)
+		{
+			TeamCap cap = getTeamCap(capHits, capPlayers[team]);
+			cap.capHit = max<caphit>(cap.capHit, 1);
+			teamFilenames[team] = directory + "/" + TEAMNAMES[team] + ".txt";
+			ofstream teamFile(teamFilenames[team].c_str());
+			teamFile.precision(0);
+			teamFile.setf(ios::fixed);
+			writeCapLines(days, months, years, teams, team, cap, teamFile, players);
+		}
 	}
 
-	bool keepReading = sched.is_open();
-
-	int currDay = 0;
-	int currMonth = 0;
-	int currYear = 0;
+	ostringstream bracketText;
+	bracketText << "4 70 78 85";
+	for(int ovbracket = 0; ovbracket < 4; ovbracket++)
+	{
+		bracketText << " 5 0.5 1 2 4";
+		for(int salarybracket = 0; salarybracket < 5; salarybracket++) bracketText << " " << 10 - 2*salarybracket + ovbracket;
+	}
+	istringstream bracketInput(bracketText.str());
+	const SalaryBrackets brackets(bracketInput);
 
-	league >> currYear;
-	league >> currMonth;
-	league >> currDay;
+	// Runs work REPEATS times and prints the fastest; work returns the bytes it went through
+	auto bench = [&](const char * name, size_t records, function<size_t()> work)
+	{
+		double best = 0;
+		size_t bytes = 0;
+		for(size_t repeat = 0; repeat < REPEATS; repeat++)
+		{
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			bytes = work();
+			double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			if(repeat == 0 || seconds < best) best = seconds;
+		}
+		best = max(best, 1e-9);
+		cout << "{\"benchmark\":\"" << name << "\",\"players\":" << nplayers << ",\"teams\":" << nteams <<
+			",\"records\":" << records << ",\"bytes\":" << bytes << ",\"seconds\":" << best <<
+			",\"records_per_s\":" << records/best << ",\"bytes_per_s\":" << bytes/best << "}" << endl;
+	};
 
-	ofstream checkFile((capdirectory + "/check_caps.txt").c_str());
-	checkFile.setf(ios::fixed);
-	checkFile.precision(0);
-
-	while(keepReading)
-	{
-		int gameDay;
-		sched >> gameDay;
-		int gameMonth;
-		sched >> gameMonth;
-		int gameYear;
-		sched >> gameYear;
-		size_t homeTeam;
-		sched >> homeTeam; homeTeam--;
-		if(homeTeam >= 0) assert(homeTeam < NTEAMS);
-		size_t awayTeam;
-		sched >> awayTeam; awayTeam--;
-		if(awayTeam >= 0) assert(awayTeam < NTEAMS);
-		int gameStatus;
-		sched >> gameStatus;
-		string temp;
-		getline(sched,temp);
-		// don't care about the score
-		getline(sched,temp);
+	bench("csv_parse", nplayers, [&]()
+	{
+		istringstream input(csv);
+		CSVReader rows(input, ',');
+		PlayerTable table;
+		for(bool more = firstCSVRow(rows); more; more = rows.nextRow())
+		{
+			table.appendCSV(rows);
+			rows.finishRow();
+		}
+		return csv.size();
+	});
+	bench("ehm_parse", nplayers, [&]()
+	{
+		EHMTokenizer tokens(ehm.data(), ehm.data() + ehm.size());
+		PlayerTable table;
+		parseEHMRecords(tokens, tokens.readInt<size_t>(), table, options.threads);
+		return ehm.size();
+	});
+	bench("ehm_write", nplayers, [&]()
+	{
+		ostringstream text;
+		OutputBuffer output(text);
+		for(size_t row = 0; row < nplayers; row++)
+		{
+			players.outputDataEHM(row, output);
+		}
+		output.flush();
+		return size_t(text.tellp());
+	});
+	bench("csv_write", nplayers, [&]()
+	{
+		ostringstream text;
+		OutputBuffer output(text);
+		for(size_t row = 0; row < nplayers; row++)
+		{
+			players.outputDataCSV(row, output, row);
+		}
+		output.flush();
+		return size_t(text.tellp());
+	});
+
+	size_t ncapPlayers = 0;
+	for(size_t team = 0; team < nteams; team++) ncapPlayers += capPlayers[team].size();
+	volatile caphit sink = 0;
+	bench("player_cap_hit", nplayers, [&]()
+	{
+		const PlayerCapHits capHits(players);
+		sink = accumulate(capHits.capHits.begin(), capHits.capHits.end(), caphit(0));
+		return size_t(0);
+	});
+	bench("team_cap_hits", ncapPlayers, [&]()
+	{
+		caphit total = 0;
+		for(size_t team = 0; team < nteams; team++)
+		{
+			total += getTeamCap(capHits, capPlayers[team]).capHit;
+		}
+		sink = total;
+		return size_t(0);
+	});
 
-		bool stillRead = gameYear < currYear;
-		if(gameYear == currYear)
+	size_t teamBytes = 0;
+	for(size_t team = 0; team < nteams; team++)
+	{
+		uint64_t size = 0, mtime = 0;
+		getFileStamp(teamFilenames[team], size, mtime);
+		teamBytes += size;
+	}
+	bench("running_cap", 2*played, [&]()
+	{
+		double total = 0;
+		for(size_t team = 0; team < nteams; team++)
+		{
+			// a full rescan, as without an index
+			DeleteFileA((teamFilenames[team] + ".idx").c_str());
+			total += getRunningCap(teamGames[team], teamFilenames[team]);
+		}
+		sink = caphit(total);
+		return teamBytes;
+	});
+	bench("schedule_load", ngames, [&]()
+	{
+		Schedule loaded(directory + "/schedule.ehm");
+		sink = loaded.countPlayed(YEAR, MONTH, DAY);
+		uint64_t size = 0, mtime = 0;
+		getFileStamp(directory + "/schedule.ehm", size, mtime);
+		return size_t(size);
+	});
+
+	const size_t NSALARIES = 1000;
+	const size_t NOVERALLS = 100;
+	bench("salary_brackets", NSALARIES*NOVERALLS, [&]()
+	{
+		double total = 0;
+		for(size_t overall = 0; overall < NOVERALLS; overall++)
 		{
-			stillRead = (gameMonth < currMonth) && (gameMonth > 0);
-			if(gameMonth == currMonth)
+			for(size_t salary = 0; salary < NSALARIES; salary++)
 			{
-				stillRead = gameDay <= currDay;
+				total += brackets.getSalary(400000 + salary*9000, 60 + overall*0.3);
 			}
 		}
+		sink = caphit(total);
+		return size_t(0);
+	});
+	vector<double> gridSalaries;
+	vector<double> gridOveralls;
+	for(size_t overall = 0; overall < NOVERALLS; overall++)
+	{
+		for(size_t salary = 0; salary < NSALARIES; salary++)
+		{
+			gridSalaries.push_back(400000 + salary*9000);
+			gridOveralls.push_back(60 + overall*0.3);
+		}
+	}
+	vector<double> gridOut(gridSalaries.size());
+	bench("salary_brackets_batch", gridSalaries.size(), [&]()
+	{
+		brackets.getSalaries(gridSalaries.data(), gridOveralls.data(), gridOut.data(), gridOut.size());
+		sink = caphit(accumulate(gridOut.begin(), gridOut.end(), 0.0));
+		return size_t(0);
+	});
+	bench("player_overall", nplayers, [&]()
+	{
+		PlayerRater rater(0.7, 0.3);
+		double total = 0;
+		for(size_t row = 0; row < nplayers; row++) total += rater.getOverall(players, row);
+		sink = caphit(total);
+		return size_t(0);
+	});
+	vector<OverallWeights> profiles;
+	for(size_t profile = 0; profile < 4; profile++)
+	{
+		OverallWeights weights = {0.5 + 0.1*profile, 0.5 - 0.1*profile};
+		profiles.push_back(weights);
+	}
+	bench("player_ratings_batch", nplayers*profiles.size(), [&]()
+	{
+		PlayerRatings rated = ratePlayers(players, profiles);
+		sink = caphit(accumulate(rated.overalls.back().begin(), rated.overalls.back().end(), 0.0));
+		return size_t(0);
+	});
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Grid mode: new salaries from the salary model (or a brackets file) for
+ * every overall and current salary on a grid, for plotting and tuning the
+ * curve. Cells are exactly what the RFA list would give, worked out a row
+ * at a time (see SalaryCurve) on --threads workers and written in order.
+ *
+ * A file ending in .bin gets a binary matrix: little-endian uint32 rows
+ * and columns, then rows doubles of overall, columns doubles of salary and
+ * rows*columns doubles of new salary, row by row, all salaries in dollars.
+ * Anything else gets CSV: a header row of salaries in millions, then each
+ * overall followed by its row of new salaries in millions.
+ */
+int runGrid(const Options & options)
+{
+	// Rows worked out per pass, bounding memory however big the grid
+	const size_t ROWBLOCK = 256;
+
+	// Axis values are min + i*step so steps don't add up rounding
+	vector<double> overalls;
+	vector<double> salaries;
+	const double * ranges[2] = {options.gridOveralls, options.gridSalaries};
+	vector<double> * axes[2] = {&overalls, &salaries};
+	for(size_t axis = 0; axis < 2; axis++)
+	{
+		const double * range = ranges[axis];
+		const size_t npoints = size_t((range[1] - range[0])/range[2] + 1e-9) + 1;
+		for(size_t i = 0; i < npoints; i++) axes[axis]->push_back(range[0] + i*range[2]);
+	}
+	for(size_t i = 0; i < salaries.size(); i++) salaries[i] *= 1.e6;
 
-		if(stillRead)
+	unique_ptr<SalaryBrackets> brackets;
+	if(!options.gridBrackets.empty())
+	{
+		ifstream bracketFile(options.gridBrackets.c_str());
+		if(!bracketFile.is_open())
 		{
-			gamesPlayed[homeTeam]++;
-			gamesPlayed[awayTeam]++;
+			cerr << "Error! Couldn't open brackets file " << options.gridBrackets << endl;
+			return EXIT_FAILURE;
+		}
+		try
+		{
+			brackets.reset(new SalaryBrackets(bracketFile));
+		}
+		catch(exception & e)
+		{
+			cerr << "Caught exception: " << e.what() << endl;
+			return EXIT_FAILURE;
+		}
+	}
 
-			bool homeGameLogged = false;
-			bool awayGameLogged = false;
+	const string & filename = options.gridFilename;
+	const bool binary = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".bin") == 0;
+	ofstream gridFile(filename.c_str(), binary ? ios::binary : ios::out);
+	if(!gridFile.is_open())
+	{
+		cerr << "Error! Couldn't open grid file " << filename << endl;
+		return EXIT_FAILURE;
+	}
 
-			caphit homeCap = getCapLine(teamFiles[homeTeam],gameDay,gameMonth,gameYear, playerCaps, npcs,
-					players, pcs, checkFile);
-			assert(homeCap >= 0);
-			homeGameLogged = homeCap > 0;
-			caphit awayCap = getCapLine(teamFiles[awayTeam],gameDay,gameMonth,gameYear, playerCaps, npcs,
-					players, pcs, checkFile);
-			assert(awayCap >= 0);
-			awayGameLogged = awayCap > 0;
+	if(binary)
+	{
+		const uint32_t dims[2] = {uint32_t(overalls.size()), uint32_t(salaries.size())};
+		gridFile.write((const char *)dims, sizeof(dims));
+		gridFile.write((const char *)overalls.data(), overalls.size()*sizeof(double));
+		gridFile.write((const char *)salaries.data(), salaries.size()*sizeof(double));
+	}
+	else
+	{
+		gridFile << "OV\\SAL";
+		char buf[32];
+		for(size_t i = 0; i < salaries.size(); i++)
+		{
+			gridFile << "," << string(buf, snprintf(buf, sizeof(buf), "%.6f", salaries[i]/1.e6));
+		}
+		gridFile << "\n";
+	}
 
-			if(homeGameLogged != awayGameLogged)
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	vector<double> cells(ROWBLOCK*salaries.size());
+	vector<string> texts(ROWBLOCK);
+	for(size_t first = 0; first < overalls.size(); first += ROWBLOCK)
+	{
+		const size_t nrows = min(ROWBLOCK, overalls.size() - first);
+		runTasks(nrows, options.threads, [&](size_t i)
+		{
+			double * row = &cells[i*salaries.size()];
+			const double overall = overalls[first + i];
+			if(brackets)
 			{
-				throw std::runtime_error("Error! Home and away games not both logged; aborting.");
+				brackets->getSalaries(overall, salaries.data(), row, salaries.size());
 			}
-
-			if(!homeGameLogged)
+			else
 			{
-				gameDays.push_back(gameDay);
-				gameMonths.push_back(gameMonth);
-				gameYears.push_back(gameYear);
-				capTeams.push_back(homeTeam);
+				SalaryCurve().getSalaries(overall, salaries.data(), row, salaries.size());
 			}
+			if(binary) return;
 
-			if(!awayGameLogged)
+			string & text = texts[i];
+			char buf[32];
+			text.assign(buf, snprintf(buf, sizeof(buf), "%g", overall));
+			for(size_t j = 0; j < salaries.size(); j++)
 			{
-				gameDays.push_back(gameDay);
-				gameMonths.push_back(gameMonth);
-				gameYears.push_back(gameYear);
-				capTeams.push_back(awayTeam);
+				text += ',';
+				text.append(buf, snprintf(buf, sizeof(buf), "%.6f", row[j]/1.e6));
 			}
-		}
+			text += '\n';
+		});
 
-		keepReading = !sched.eof() && stillRead;
+		if(binary)
+		{
+			gridFile.write((const char *)cells.data(), nrows*salaries.size()*sizeof(double));
+		}
+		else
+		{
+			for(size_t i = 0; i < nrows; i++) gridFile << texts[i];
+		}
 	}
+	gridFile.close();
+	if(gridFile.fail())
+	{
+		cerr << "Error! Couldn't write grid file " << filename << endl;
+		return EXIT_FAILURE;
+	}
+
+	cout << "Wrote " << overalls.size() << " x " << salaries.size() << " grid to " << filename << " in " <<
+		chrono::duration<double>(chrono::steady_clock::now() - start).count() << " s" << endl;
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Watch mode: recomputes the cap reports for the command line's save
+ * whenever its schedule.ehm or league.ehm or the players file changes,
+ * until killed. Parsed inputs and per-team results are kept between
+ * recomputes, and team cap files are only appended to and summed from
+ * where the last run stopped, so an update costs little more than parsing
+ * the new players file.
+ */
+int runWatch(const vector<string> & args, const Options & options)
+{
+	// How long the save must stay unchanged before it's read, as EHM writes several files
+	const DWORD SETTLEMS = 200;
+	const size_t NWATCHED = 3;
 
-	checkFile.close();
+	const string & savedir = args[8];
+	const string watched[NWATCHED] = {args[1], savedir + "/schedule.ehm", savedir + "/league.ehm"};
 
-	for(size_t i = 0; i < NTEAMS; i++)
+	DWORD attributes = GetFileAttributesA(args[5].c_str());
+	if(attributes == INVALID_FILE_ATTRIBUTES || !(attributes & FILE_ATTRIBUTE_DIRECTORY))
 	{
-		// Tally up penalties and LTIR separately
-		auto rv = getCapHits(capPlayers[i],0,currYear,currMonth,currDay);
-		caphits[i] = rv.first;
-		ncontracts[i] = rv.second;
+		cerr << "Error! Directory " << args[5] << " does not exist; please create it first." << endl;
+		return EXIT_FAILURE;
 	}
 
-	for(size_t i = 0; i < NTEAMS; i++) teamFiles[i].close();
-
-	if(!capTeams.empty())
+	size_t slash = args[1].find_last_of("/\\");
+	string directories[2] = {savedir, slash == string::npos ? "." : args[1].substr(0, slash)};
+	const DWORD nchanges = directories[1] == directories[0] ? 1 : 2;
+	HANDLE changes[2];
+	for(DWORD i = 0; i < nchanges; i++)
 	{
-		ofstream teamOFiles[NTEAMS];
-		for(size_t i = 0; i < NTEAMS; i++)
+		changes[i] = FindFirstChangeNotificationA(directories[i].c_str(), FALSE,
+			FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE);
+		if(changes[i] == INVALID_HANDLE_VALUE)
 		{
-			teamOFiles[i].open((teamFilenames[i]).c_str(),std::ofstream::app);
-			teamOFiles[i].precision(0);
-			teamOFiles[i].setf(ios::fixed);
+			cerr << "Error! Can't watch directory " << directories[i] << endl;
+			return EXIT_FAILURE;
 		}
+	}
 
-		writeCapLines(gameDays,gameMonths,gameYears,capTeams,caphits,ncontracts,
-			teamOFiles,capPlayers,penalties,ltir);
+	// size and write time of each watched file, zero while one is missing
+	struct Stamps
+	{
+		uint64_t values[2*NWATCHED];
 
-		for(size_t i = 0; i < NTEAMS; i++)
+		bool read(const string files[NWATCHED])
 		{
-			teamOFiles[i].close();
+			bool all = true;
+			for(size_t i = 0; i < NWATCHED; i++)
+			{
+				values[2*i] = values[2*i+1] = 0;
+				all = getFileStamp(files[i], values[2*i], values[2*i+1]) && all;
+			}
+			return all;
 		}
-	}
 
-	double runningCaps[NTEAMS];
-	for(size_t i = 0; i < NTEAMS; i++)
+		bool operator==(const Stamps & other) const
+		{
+			return equal(values, values + 2*NWATCHED, other.values);
+		}
+	};
+
+	SharedInputs inputs;
+	ReportCache cache;
+	Stamps done;
+	memset(&done, 0, sizeof(done));
+	cout << "Watching " << savedir << " and " << args[1] << " for changes" << endl;
+	for(;;)
 	{
-		runningCaps[i] = 0;
-		teamFiles[i].open((teamFilenames[i]).c_str());
-	}
+		Stamps current;
+		bool complete = current.read(watched);
+		if(!(current == done))
+		{
+			Stamps settled;
+			do
+			{
+				settled = current;
+				Sleep(SETTLEMS);
+				complete = current.read(watched);
+			}
+			while(!(current == settled));
 
-	ofstream capFile(capdirectory + "/caphits.txt");
-	capFile.setf(ios::fixed);
-	capFile.precision(0);
+			if(complete)
+			{
+				chrono::steady_clock::time_point start = chrono::steady_clock::now();
+				// Each update gets stats of its own
+				RunStats stats;
+				Options updateOptions = options;
+				if(options.keepStats) updateOptions.stats = &stats;
+				try
+				{
+					shared_ptr<const PlayerTable> players = convertPlayers(args, inputs, updateOptions);
+					capReports(args, *players, inputs, updateOptions, &cache);
+					cout << "Updated " << args[5] << " in " <<
+						chrono::duration<double>(chrono::steady_clock::now() - start).count() << " s" << endl;
+					if(options.keepStats) writeStats(stats, options);
+				}
+				catch(exception & e)
+				{
+					cerr << "Caught exception: " << e.what() << endl;
+				}
+				done = current;
+			}
+		}
 
-	char buf[1000];
-	capFile << "TEAM  TEAMID  GP  TODAY     TODATE    PENALTIES LTIR      PROJECTED OVER_CAP CONTR  MAXCAP    CAPSPACE" << endl;
+		DWORD signaled = WaitForMultipleObjects(nchanges, changes, FALSE, INFINITE) - WAIT_OBJECT_0;
+		if(signaled >= nchanges || !FindNextChangeNotification(changes[signaled]))
+		{
+			cerr << "Error! Lost the watch on " << directories[0] << endl;
+			for(DWORD i = 0; i < nchanges; i++) FindCloseChangeNotification(changes[i]);
+			return EXIT_FAILURE;
+		}
+	}
+}
 
-	for(size_t team = 0; team < NTEAMS; team++)
-	{
-		double caphit = getAdjustedCap(caphits[team], penalties[team], ltir[team], MAXCAP);
-		double todate = getRunningCap(teamFiles[team], gamesPlayed[team], teamFilenames[team]);
-		if(gamesPlayed[team] > 0) todate /= gamesPlayed[team];
-		double projected = (todate*gamesPlayed[team] + caphit * double(NGAMES - gamesPlayed[team]))/double(NGAMES);
-		std::string over = projected > MAXCAP ? "Y" : "N";
-		double maxcap = (MAXCAP*NGAMES - todate*gamesPlayed[team])/double(NGAMES - gamesPlayed[team]);
-		double capspace = maxcap-caphit;
+int main(int argc, char * argv[])
+{
+	Options options;
+	parseOptions(argc, argv, options);
+	RunStats stats;
+	if(options.keepStats) options.stats = &stats;
 
-		sprintf(buf, "%-6s%-6i%-6i%-10i%-10i%-10i%-10i%-10i  %-6s %-6i %-10i %-i",
-			TEAMNAMES[team].c_str(),team+1, gamesPlayed[team],
-			int(caphit), int(todate), penalties[team], ltir[team],
-			int(projected), over.c_str(), ncontracts[team], int(maxcap), int(capspace));
-		capFile << buf << endl;
+	if(options.benchPlayers > 0)
+	{
+		return runBenchmarks(options.benchPlayers, options.benchTeams, options.benchDirectory, options);
 	}
 
-	capFile.close();
-}
+	if(!options.gridFilename.empty())
+	{
+		return runGrid(options);
+	}
 
-void readPenalties(char* filename, caphit * out)
-{
-	ifstream file;
-	file.open(filename);
-	std::string teamname;
-	std::string line;
-	for(size_t i = 0; i < NTEAMS; i++)
+	if(!options.batch.empty())
 	{
-		double total = 0;
-		std::getline(file, line);
-		std::stringstream ss(line);
-		ss >> teamname;
-		if(teamname != TEAMNAMES[i])
-		{
-			throw std::runtime_error("Error! Team " +
-				teamname + "!=team[" + to_string(i) +
-				"]=" + TEAMNAMES[i] + " in file " +
-				filename + "; aborting.");
-		}
-		double penalty;
-		while(ss >> penalty)
+		if(argc > 1)
 		{
-			total += penalty;
+			cerr << "Error! --batch takes the arguments of each run from the manifest" << endl;
+			exit(EXIT_FAILURE);
 		}
-		out[i] = total;
+		return runBatch(options.batch, options);
 	}
-	file.close();
-}
 
-int main(int argc, char * argv[])
-{
 	if(argc < 3 || argc > 12)
 	{
 		cout << "Error! Must have minimum 2 input arguments: " << endl
@@ -1267,111 +5168,74 @@ int main(int argc, char * argv[])
 				<< "5. salary cap output directory, 6. optional cap penalty file" << endl
 				<< "(Cap penalties must be 30 line file in same order as teams file)" << endl;
 		cout << "7. LTIR file 8. Save directory " << endl;
+		cout << "--threads=N parses EHM files and checks team caps on N threads (0 for one per core)" << endl;
+		cout << "--snapshot caches parsed EHM files in <file>.snap for later runs" << endl;
+		cout << "--stream converts (3 arguments only) without holding the file in memory; - is stdin/stdout" << endl;
+		cout << "--batch=FILE runs each line of FILE as the arguments of a separate run" << endl;
+		cout << "--watch reruns the cap reports whenever the save (8.) or input file changes" << endl;
+		cout << "--bench[=PLAYERS] [--bench-teams=N] [--bench-dir=DIR] times the core steps on a synthetic league" << endl;
+		cout << "--grid=FILE [--grid-overall=MIN:MAX:STEP] [--grid-salary=MIN:MAX:STEP] [--grid-brackets=FILE]" << endl
+				<< "  writes new salaries over an overall x salary (millions) grid as CSV, or binary for FILE.bin" << endl;
+		cout << "--cap-model also writes every team's cap figures and player cap hits to the cap directory" << endl
+				<< "  (5.) as cap_model.csv and cap_model.json" << endl;
+		cout << "--stats[=FILE] writes the time, bytes and records of each step as JSON to FILE (default stdout)" << endl;
 		exit(EXIT_FAILURE);
 	}
 
-	const int tempdataSize = 1024;
-	char tempdata[tempdataSize];
-
-	ifstream inputFile;
-	inputFile.open(argv[1]);
-
-	ofstream outputFile;
-	outputFile.open(argv[2]);
-
-	const string CSV = argv[3];
-	const bool isCSV = (CSV == "1" || CSV == "T" || CSV == "true" || CSV == "True");
-
-	size_t nplayers = 0;
-
-	std::vector<Player> players;
-	if(!isCSV)
+	if(argc == 5)
 	{
-		inputFile >> nplayers;
-		players.reserve(nplayers);
+		cerr << "Error! A start of season file (4.) needs a salary cap output directory (5.) after it" << endl;
+		exit(EXIT_FAILURE);
 	}
 
-	if(isCSV)
+	if(options.streaming)
 	{
-		outputFile << "         " << std::endl;
-		int next = inputFile.peek();
-		while(next != EOF)
+		if(argc != 4)
 		{
-			players.push_back(Player(inputFile, !isCSV, tempdata, tempdataSize, nplayers));
-			players[nplayers].outputDataEHM(outputFile);
-			nplayers++;
-			next = inputFile.peek();
+			cerr << "Error! --stream only converts, with the first 3 arguments" << endl;
+			exit(EXIT_FAILURE);
 		}
-		outputFile.seekp(0, ios_base::beg);
-		outputFile << " " << nplayers << " ";
+		const string CSV = argv[3];
+		try
+		{
+			ios::sync_with_stdio(false);
+			streamConversion(argv[1], argv[2], CSV == "1" || CSV == "T" || CSV == "true" || CSV == "True");
+		}
+		catch(exception & e)
+		{
+			cerr << "Caught exception: " << e.what() << endl;
+			exit(EXIT_FAILURE);
+		}
+		return EXIT_SUCCESS;
 	}
-	else
+
+	const vector<string> args(argv, argv + argc);
+	if(options.watch)
 	{
-		outputFile << "\"sh\",\"pl\",\"st\",\"ch\",\"po\",\"hi\",\"sk\",\"en\",\"pe\","
-					"\"fa\",\"le\",\"str\",\"pot\",\"con\",\"gre\",\"fi\",\"click\",\"team\","
-					"\"position\",\"country\",\"hand\",\"byear\",\"bday\",\"bmonth\",\"salary\","
-					"\"years\",\"draft_year\",\"draft_round\",\"draft_team\",\"rights\",\"thisweek_gp\","
-					"\"thisweek_g\",\"thisweek_a\",\"thisweek_gwg\",\"thismonth_gp\",\"thismonth_g\","
-					"\"thismonth_a\",\"thismonth_gwg\",\"records_g\",\"records_a\",\"records_p\","
-					"\"notrade\",\"twoway\",\"option\",\"status\",\"rookie\",\"offer_status\","
-					"\"offer_team\",\"offer_time\",\"injury_status\",\"scout_1_10\","
-					"\"scout_11_20\",\"scout_21_30\",\"streak_g\",\"streak_p\",\"gp\",\"suspension\","
-					"\"training\",\"weight\",\"height\",\"status_org\",\"streak_best_gp\","
-					"\"streak_best_gwg\",\"streak_best_p\",\"streak_best_a\",\"streak_best_g\","
-					"\"unused\",\"name_first\",\"name_last\",\"performance\",\"acquired\",\"ceil_fi\","
-					"\"ceil_sh\",\"ceil_pl\",\"ceil_st\",\"ceil_ch\",\"ceil_po\",\"ceil_hi\","
-					"\"ceil_sk\",\"ceil_en\",\"ceil_pe\",\"ceil_fa\",\"ceil_le\",\"ceil_str\","
-					"\"version\",\"attitude\",\"position_alt\",\"rights_2\","
-					"\"injury_prone\",\"draft_overall\",\"id\"" << std::endl;
-		for(uint i = 0; i < nplayers; i++)
+		if(argc < 9)
 		{
-			players.push_back(Player(inputFile, !isCSV, tempdata, tempdataSize, i));
-			players[i].outputDataCSV(outputFile, i);
+			cerr << "Error! --watch needs a save directory" << endl;
+			exit(EXIT_FAILURE);
 		}
+		return runWatch(args, options);
 	}
 
-	inputFile.close();
+	SharedInputs inputs;
+	shared_ptr<const PlayerTable> players;
+	try
+	{
+		players = convertPlayers(args, inputs, options);
+	}
+	catch(exception & e)
+	{
+		cerr << "Caught exception: " << e.what() << endl;
+		exit(EXIT_FAILURE);
+	}
 
 	try
 	{
 		if(argc > 4)
 		{
-			ifstream capFile;
-			capFile.open(argv[4]);
-
-			Player * playerCaps[nplayers];
-
-			vector<Player*> capPlayers[NTEAMS];
-
-			for(int i = 0; i < nplayers; i++)
-			{
-				playerCaps[i] = new Player(capFile, true, tempdata, tempdataSize,i);
-
-				const Player & p = *(playerCaps[i]);
-				int team = p.getRights();
-				bool ahl = team > NTEAMS && team <= 2*NTEAMS;
-
-				// Add AHL players too
-				if((((team > 0) && (team <= NTEAMS)) || ahl) && p.getContractLength() > 0)
-				{
-					capPlayers[team-1-ahl*NTEAMS].push_back(playerCaps[i]);
-					/*
-					if(players[i]->getContractLength() == 0)
-					{
-						capPlayers[team-1].push_back(players[i]);
-					}
-					else
-					{
-						capPlayers[team-1].push_back(playerCaps[i]);
-					}
-					*/
-				}
-			}
-
-			capFile.close();
-			vector<Player*>::const_iterator it;
-
-			ofstream capOutfile;
 			string capdir = string(argv[5]);
 
 			if(!(::GetFileAttributesA(capdir.c_str()) && FILE_ATTRIBUTE_DIRECTORY))
@@ -1380,92 +5244,7 @@ int main(int argc, char * argv[])
 				exit(EXIT_FAILURE);
 			}
 
-			caphit penalties[NTEAMS];
-
-			if(argc > 6)
-			{
-				readPenalties(argv[6], penalties);
-			}
-			else
-			{
-				for(int i = 0; i < NTEAMS; i++) penalties[i] = 0;
-			}
-
-			caphit ltir[NTEAMS];
-
-			if(argc > 7)
-			{
-				readPenalties(argv[7], ltir);
-			}
-			else
-			{
-				for(size_t i = 0; i < NTEAMS; i++) ltir[i] = 0;
-			}
-
-			if(argc > 8)
-			{
-				string savedir = argv[8];
-				calcSalariesFromSchedule(savedir, capdir, NTEAMS, capPlayers, playerCaps, nplayers,
-						players, nplayers, penalties, ltir);
-				capOutfile.open((capdir + "/" + "caps.txt").c_str());
-
-				string leagueFile = savedir + "/league.ehm";
-				ifstream league(leagueFile);
-
-				int year; int month; int day;
-				league >> year;
-				league >> month;
-				league >> day;
-
-				for(size_t i = 0; i < NTEAMS; i++)
-				{
-					sort(capPlayers[i].begin(), capPlayers[i].end(), higherSalary);
-					capOutfile << TEAMNAMES[i] << endl;
-					int playersCounted = 0;
-
-					auto caps = getCapHits(capPlayers[i], penalties[i],
-						year, month, day);
-					caphit teamcap = caps.first;
-					caphit tcaprun = 0;
-
-					for (it=capPlayers[i].begin(); it!=capPlayers[i].end(); ++it)
-					{
-						const Player & p = (**it);
-						caphit pcaphit = getPlayerCapHit(**it, year, month, day);
-						capOutfile << p.getLastName() << ", " << p.getFirstName() << "\t" <<
-						pcaphit << endl;
-						tcaprun += pcaphit;
-						playersCounted++;
-						/*
-						if(playersCounted == 23)
-						{
-							break;
-						}*/
-					}
-					capOutfile << "Roster: " << tcaprun << endl;
-					capOutfile << "Penalties: " << penalties[i] << endl;
-					capOutfile << "Total: " << tcaprun+penalties[i] <<
-						" vs. final " << teamcap << endl;
-					capOutfile << "Contracts: " << caps.second << endl << endl;
-				}
-
-				capOutfile.close();
-			}
-
-			if(argc > 9)
-			{
-				string salaryFilename = argv[9];
-				string overallFilename = argv[10];
-
-				if(argc > 11)
-				{
-					outputNewSalariesInfo(players, nplayers, salaryFilename, overallFilename, string(argv[11]));
-				}
-				else
-				{
-					outputNewSalariesInfo(players, nplayers, salaryFilename, overallFilename);
-				}
-			}
+			capReports(args, *players, inputs, options);
 		}
 	}
 	catch(exception & e)
@@ -1473,5 +5252,6 @@ int main(int argc, char * argv[])
 		cerr << "Caught exception: " << e.what() << endl;
 	}
 
+	if(options.stats != NULL) writeStats(stats, options);
 	return EXIT_SUCCESS;
 }